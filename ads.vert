@@ -3,9 +3,7 @@ attribute vec3 normal;
 attribute vec2 tcoord0;
 attribute vec3 tangent;
 
-uniform mat4 mv;
-uniform mat4 perspective;
-uniform vec3 light;
+#include "uniform_blocks.glsl"
 
 varying vec2 tcoord;
 varying vec3 eyeDir;
@@ -0,0 +1,59 @@
+uniform sampler2D colors;
+uniform sampler2D norm_spec;
+#ifdef NIGHT_LIGHTS
+uniform sampler2D night_lights;
+#endif
+
+// lightDir and eyeDir are in tangent space and need not be normalized.
+// NIGHT_LIGHTS and SPECULAR switch those terms on, without them they
+// cost nothing.
+vec4 ads_lighting(vec2 tcoord, vec3 eyeDir, vec3 lightDir) {
+  // lightDir and eyeDir are already in tangent space so we can just
+  // read our normal
+  vec4 normSpec = texture2D(norm_spec, tcoord);
+  vec3 normal = normalize(normSpec.rgb * 2.0 - 1.0);
+
+  // proportional to the energy received by the surface
+  float diffuseCoeff = dot(normal, lightDir);
+  vec4 nightColor = vec4(0,0,0,0);
+  const float ambient = 0.1;
+
+  if(diffuseCoeff <= 0) {
+    diffuseCoeff = 0;
+#ifdef NIGHT_LIGHTS
+    nightColor = texture2D(night_lights, tcoord);
+
+    // only let the bright parts through
+    if(length(vec3(nightColor)) < 0.6) {
+      nightColor = vec4(0,0,0,0);
+    }
+#endif
+  }
+
+  vec4 color = (diffuseCoeff + ambient) * texture2D(colors, tcoord) + nightColor;
+
+#ifdef SPECULAR
+  vec3 light = normalize(lightDir);
+  vec3 eye = normalize(eyeDir);
+
+  // constants
+  const float shininess = 100;
+  const vec4 spec_color = vec4(1,1,0.8,1);
+  const float specular_intensity = 0.4;
+
+  // sort of like the amount of light that is directly reflecting into
+  // the eye
+  vec3 reflection = reflect(-light, normal);
+  float eyeReflectionAngle = dot(reflection, eye);
+
+  float specCoeff = normSpec.a;
+  float spec = max(0, specular_intensity * pow(eyeReflectionAngle, shininess * specCoeff)) * length(color);
+
+  // kill specular if normal is facing away from light
+  if(dot(light, normal) < 0) spec = 0;
+
+  color += spec_color * spec;
+#endif
+
+  return color;
+}
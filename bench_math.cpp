@@ -0,0 +1,609 @@
+#include "matrix.h"
+#include "matrix_kernels.h"
+#include "transform.h"
+#include "camera.h"
+#include "point_array.h"
+#include "geodetic.h"
+#include "geodesic.h"
+#include "thread_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC
+#endif
+
+// timings of the math hot paths and checks of how far the fast versions
+// stray from the reference ones, so changes to either show up in
+// review. every benchmark is warmed up, then timed in samples of many
+// calls, and the per item times of the samples summarized. ticks are
+// the cpu's time stamp counter, which runs at a fixed rate on anything
+// recent, so they're cycles at the nominal clock. MATRIX_KERNELS picks
+// the matrix kernel set like it does for main.
+//
+// the pooled benchmarks spread their work over a thread pool, of one
+// thread per cpu unless --threads says otherwise. their times are still wall clock per item, so
+// Mitems/s/core, which divides by the pool size, is what compares them
+// with the single threaded ones.
+
+// meters per unit for the geodetic checks
+static const double meters = 6378137.0;
+
+static const unsigned samples = 25;
+static const double warmup_seconds = 0.02;
+static const double sample_seconds = 0.002;
+
+static double now() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static unsigned long long ticks() {
+#ifdef HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+static double frand(double lo, double hi) {
+  return lo + (hi - lo) * (rand() / (double)RAND_MAX);
+}
+
+// per item nanoseconds over the samples
+struct Result {
+  std::string name;
+  unsigned items;
+  unsigned threads;
+  double min, median, mean, stddev, p95;
+  double ticks;
+};
+
+struct Check {
+  std::string name;
+  double value;
+  const char* unit;
+};
+
+typedef void (*BenchFn)(void* ctx);
+
+static Result measure(const char* name, unsigned items, unsigned threads, BenchFn fn,
+                      void* ctx) {
+  // warm caches, branch predictors and the clock
+  double start = now();
+  unsigned calls = 0;
+  do {
+    fn(ctx);
+    calls++;
+  } while(now() - start < warmup_seconds);
+
+  // enough calls per sample that timer resolution doesn't matter
+  double per_call = (now() - start) / calls;
+  unsigned reps = std::max(1u, unsigned(sample_seconds / per_call));
+
+  std::vector<double> ns(samples), tk(samples);
+  for(unsigned ss = 0; ss < samples; ++ss) {
+    double t0 = now();
+    unsigned long long k0 = ticks();
+    for(unsigned rr = 0; rr < reps; ++rr) fn(ctx);
+    unsigned long long k1 = ticks();
+    double t1 = now();
+
+    ns[ss] = (t1 - t0) * 1e9 / (double(reps) * items);
+    tk[ss] = double(k1 - k0) / (double(reps) * items);
+  }
+
+  Result r;
+  r.name = name;
+  r.items = items;
+  r.threads = threads;
+
+  double sum = 0, sum2 = 0;
+  for(unsigned ss = 0; ss < samples; ++ss) {
+    sum += ns[ss];
+    sum2 += ns[ss] * ns[ss];
+  }
+  r.mean = sum / samples;
+  r.stddev = sqrt(std::max(0.0, sum2 / samples - r.mean * r.mean));
+
+  std::sort(ns.begin(), ns.end());
+  std::sort(tk.begin(), tk.end());
+  r.min = ns[0];
+  r.median = ns[samples / 2];
+  r.p95 = ns[std::min(samples - 1, unsigned(samples * 0.95))];
+  r.ticks = tk[samples / 2];
+  return r;
+}
+
+// inputs shaped like what the renderer and overlays feed these: rigid
+// modelviews, the same scaled and sheared, projections times modelviews, unit quaternions and
+// points spread evenly over the globe
+const unsigned nmatrices = 1024;
+const unsigned npoints = 1 << 16;
+const unsigned npairs = 1024;
+const unsigned nqueries = 64;
+// enough pairs that the pool splits them
+const unsigned npooled_pairs = 1 << 18;
+
+struct Inputs {
+  std::vector<Matrix> rigid, affine, projective, out;
+  std::vector<Rigid<float> > rigid_t, rigid_out;
+  std::vector<Vector4> vectors, vectors_out;
+  std::vector<Quaternion> quats, quats_out;
+  std::vector<Vector> points_out;
+  GeodeticArray geo, geo_out, geo_a, geo_b, geo_q, geo_c, geo_d;
+  PointArray ecef, ecef_out;
+  std::vector<float> distance;
+  std::vector<unsigned> index;
+  Matrix mvp;
+};
+
+static Quaternion random_quaternion() {
+  Quaternion q(frand(-1, 1), frand(-1, 1), frand(-1, 1), frand(-1, 1));
+  q.normalize();
+  return q;
+}
+
+static void random_geodetic(unsigned n, float max_height, GeodeticArray* out) {
+  out->resize(0);
+  for(unsigned ii = 0; ii < n; ++ii) {
+    out->push_back(asin(frand(-1, 1)), frand(-M_PI, M_PI), frand(0, max_height));
+  }
+}
+
+static void make_inputs(Inputs* in) {
+  srand(1);
+  Camera camera(d2r(60), 16.0f / 9.0f, 0.1, 1000.0);
+  Matrix perspective = camera.getPerspectiveTransform();
+
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    Vector axis(frand(-1, 1), frand(-1, 1), frand(-1, 1));
+    Rigid<float> r = Rigid<float>::rotation(frand(-M_PI, M_PI), axis);
+    r.t = Vec3<float>(frand(-10, 10), frand(-10, 10), frand(-10, 10));
+
+    in->rigid_t.push_back(r);
+    in->rigid.push_back(r.matrix());
+
+    Matrix scale_shear;
+    scale_shear.set_scale(frand(0.1, 10), frand(0.1, 10), frand(0.1, 10));
+    scale_shear.elm(0, 1) = frand(-1, 1);
+    scale_shear.elm(1, 2) = frand(-1, 1);
+    in->affine.push_back(r.matrix() * scale_shear);
+    in->projective.push_back(perspective * r.matrix());
+    in->vectors.push_back(Vector4(frand(-1, 1), frand(-1, 1), frand(-1, 1), 1));
+    in->quats.push_back(random_quaternion());
+  }
+  in->out.resize(nmatrices);
+  in->rigid_out.resize(nmatrices);
+  in->vectors_out.resize(nmatrices);
+  in->quats_out.resize(nmatrices);
+  in->points_out.resize(nmatrices);
+
+  // heights up to ~60km
+  random_geodetic(npoints, 0.01f, &in->geo);
+  geodetic_to_ecef(in->geo, &in->ecef);
+  in->mvp = in->projective[0];
+
+  random_geodetic(npairs, 0, &in->geo_a);
+  random_geodetic(npairs, 0, &in->geo_b);
+  random_geodetic(nqueries, 0, &in->geo_q);
+  random_geodetic(npooled_pairs, 0, &in->geo_c);
+  random_geodetic(npooled_pairs, 0, &in->geo_d);
+}
+
+static Inputs inputs;
+
+static void bench_multiply(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    inputs.out[ii] = inputs.projective[ii] * inputs.rigid[nmatrices - 1 - ii];
+  }
+}
+
+static void bench_invert(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) inputs.out[ii] = inputs.projective[ii].invert();
+}
+
+static void bench_invertspecial(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) inputs.out[ii] = inputs.rigid[ii].invertspecial();
+}
+
+static void bench_invert_affine(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) inputs.out[ii] = inputs.affine[ii].invert_affine();
+}
+
+static void bench_matrix_vector(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    inputs.vectors_out[ii] = inputs.projective[ii] * inputs.vectors[ii];
+  }
+}
+
+static void bench_rigid_compose(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    inputs.rigid_out[ii] = inputs.rigid_t[ii] * inputs.rigid_t[nmatrices - 1 - ii];
+  }
+}
+
+static void bench_rigid_inverse(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) inputs.rigid_out[ii] = inputs.rigid_t[ii].inverse();
+}
+
+static void bench_quaternion_multiply(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    inputs.quats_out[ii] = inputs.quats[ii] * inputs.quats[nmatrices - 1 - ii];
+  }
+}
+
+static void bench_quaternion_matrix(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) inputs.out[ii] = inputs.quats[ii].matrix();
+}
+
+static void bench_quaternion_rotate(void*) {
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    const Vector4& v = inputs.vectors[ii];
+    inputs.points_out[ii] = inputs.quats[ii] * Vector(v.x, v.y, v.z);
+  }
+}
+
+static void bench_from_lat_lon(void*) {
+  const GeodeticArray& g = inputs.geo;
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    inputs.points_out[ii] = Point::fromLatLon(g.lat[ii], g.lon[ii], g.h[ii]);
+  }
+}
+
+static void bench_to_lat_lon(void*) {
+  static double lat, lon, h;
+  for(unsigned ii = 0; ii < nmatrices; ++ii) inputs.ecef[ii].toLatLon(&lat, &lon, &h);
+}
+
+static void bench_transform_points(void*) {
+  transform_points(inputs.rigid[0], inputs.ecef, &inputs.ecef_out);
+}
+
+static void bench_project_points(void*) {
+  project_points(inputs.mvp, 1920, 1080, inputs.ecef, &inputs.ecef_out);
+}
+
+static void bench_geodetic_to_ecef(void*) {
+  geodetic_to_ecef(inputs.geo, &inputs.ecef_out);
+}
+
+static void bench_ecef_to_geodetic(void*) {
+  ecef_to_geodetic(inputs.ecef, &inputs.geo_out);
+}
+
+static void bench_haversine_pairs(void*) {
+  geodesic_pairs(GEODESIC_HAVERSINE, inputs.geo_a, inputs.geo_b, &inputs.distance, NULL);
+}
+
+static void bench_vincenty_pairs(void*) {
+  geodesic_pairs(GEODESIC_VINCENTY, inputs.geo_a, inputs.geo_b, &inputs.distance, NULL);
+}
+
+static void bench_haversine_all_pairs(void*) {
+  geodesic_all_pairs(GEODESIC_HAVERSINE, inputs.geo_a, inputs.geo_b, &inputs.distance, NULL);
+}
+
+static void bench_haversine_nearest(void*) {
+  geodesic_nearest(GEODESIC_HAVERSINE, inputs.geo_q, inputs.geo, &inputs.index, NULL);
+}
+
+static void bench_vincenty_nearest(void*) {
+  geodesic_nearest(GEODESIC_VINCENTY, inputs.geo_q, inputs.geo, &inputs.index, NULL);
+}
+
+// ctx is the ThreadPool
+static void bench_haversine_pairs_pooled(void* pool) {
+  geodesic_pairs(GEODESIC_HAVERSINE, inputs.geo_c, inputs.geo_d, &inputs.distance, NULL,
+                 (ThreadPool*)pool);
+}
+
+static void bench_vincenty_pairs_pooled(void* pool) {
+  geodesic_pairs(GEODESIC_VINCENTY, inputs.geo_c, inputs.geo_d, &inputs.distance, NULL,
+                 (ThreadPool*)pool);
+}
+
+static void bench_haversine_all_pairs_pooled(void* pool) {
+  geodesic_all_pairs(GEODESIC_HAVERSINE, inputs.geo_a, inputs.geo_b, &inputs.distance, NULL,
+                     (ThreadPool*)pool);
+}
+
+static void bench_vincenty_all_pairs_pooled(void* pool) {
+  geodesic_all_pairs(GEODESIC_VINCENTY, inputs.geo_a, inputs.geo_b, &inputs.distance, NULL,
+                     (ThreadPool*)pool);
+}
+
+static void bench_haversine_nearest_pooled(void* pool) {
+  geodesic_nearest(GEODESIC_HAVERSINE, inputs.geo_q, inputs.geo, &inputs.index, NULL,
+                   (ThreadPool*)pool);
+}
+
+static void bench_vincenty_nearest_pooled(void* pool) {
+  geodesic_nearest(GEODESIC_VINCENTY, inputs.geo_q, inputs.geo, &inputs.index, NULL,
+                   (ThreadPool*)pool);
+}
+
+struct Benchmark {
+  const char* name;
+  BenchFn fn;
+  // items one call covers
+  unsigned items;
+};
+
+static const Benchmark benchmarks[] = {
+  {"matrix_multiply", bench_multiply, nmatrices},
+  {"matrix_invert", bench_invert, nmatrices},
+  {"matrix_invertspecial", bench_invertspecial, nmatrices},
+  {"matrix_invert_affine", bench_invert_affine, nmatrices},
+  {"matrix_vector", bench_matrix_vector, nmatrices},
+  {"rigid_compose", bench_rigid_compose, nmatrices},
+  {"rigid_inverse", bench_rigid_inverse, nmatrices},
+  {"quaternion_multiply", bench_quaternion_multiply, nmatrices},
+  {"quaternion_matrix", bench_quaternion_matrix, nmatrices},
+  {"quaternion_rotate", bench_quaternion_rotate, nmatrices},
+  {"point_from_lat_lon", bench_from_lat_lon, nmatrices},
+  {"point_to_lat_lon", bench_to_lat_lon, nmatrices},
+  {"transform_points", bench_transform_points, npoints},
+  {"project_points", bench_project_points, npoints},
+  {"geodetic_to_ecef", bench_geodetic_to_ecef, npoints},
+  {"ecef_to_geodetic", bench_ecef_to_geodetic, npoints},
+  {"haversine_pairs", bench_haversine_pairs, npairs},
+  {"vincenty_pairs", bench_vincenty_pairs, npairs},
+  {"haversine_all_pairs", bench_haversine_all_pairs, npairs * npairs},
+  {"haversine_nearest", bench_haversine_nearest, nqueries * npoints},
+  {"vincenty_nearest", bench_vincenty_nearest, nqueries * npoints},
+};
+
+static const Benchmark pooled_benchmarks[] = {
+  {"haversine_pairs_pooled", bench_haversine_pairs_pooled, npooled_pairs},
+  {"vincenty_pairs_pooled", bench_vincenty_pairs_pooled, npooled_pairs},
+  {"haversine_all_pairs_pooled", bench_haversine_all_pairs_pooled, npairs * npairs},
+  {"vincenty_all_pairs_pooled", bench_vincenty_all_pairs_pooled, npairs * npairs},
+  {"haversine_nearest_pooled", bench_haversine_nearest_pooled, nqueries * npoints},
+  {"vincenty_nearest_pooled", bench_vincenty_nearest_pooled, nqueries * npoints},
+};
+
+// millions of items a second for each thread doing the work
+static double mitems_per_core(const Result& r) {
+  return 1e3 / (r.median * r.threads);
+}
+
+static double max_abs_diff(const Matrix& a, const Matrix& b) {
+  double d = 0;
+  for(unsigned ii = 0; ii < 16; ++ii) d = std::max(d, (double)fabs(a.data[ii] - b.data[ii]));
+  return d;
+}
+
+static void run_checks(std::vector<Check>* checks) {
+  // what test_quat used to print for eyeballing
+  double quat_matrix = 0, quat_rotate = 0, rigid = 0, affine = 0;
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    const Quaternion& q = inputs.quats[ii];
+    float angle = 2 * acosf(std::min(1.0f, fabsf(q.w)));
+    Vector axis = Vector(q.x, q.y, q.z) * (q.w < 0 ? -1.0f : 1.0f);
+    if(axis.mag() > 1e-3) {
+      quat_matrix = std::max(quat_matrix, max_abs_diff(q.matrix(), Matrix::rotation(angle, axis)));
+    }
+
+    const Vector4& v4 = inputs.vectors[ii];
+    Vector v(v4.x, v4.y, v4.z);
+    Vector a = q * v, b = q.matrix() * v;
+    quat_rotate = std::max(quat_rotate, (double)(a + -b).mag());
+
+    Matrix composed = (inputs.rigid_t[ii] * inputs.rigid_t[nmatrices - 1 - ii]).matrix();
+    rigid = std::max(rigid, max_abs_diff(composed, inputs.rigid[ii] * inputs.rigid[nmatrices - 1 - ii]));
+
+    const Matrix& m = inputs.affine[ii];
+    affine = std::max(affine, max_abs_diff(m.invert_affine(), m.invert()));
+  }
+  Check c1 = {"quaternion_matrix_vs_rotation", quat_matrix, "abs"};
+  Check c2 = {"quaternion_rotate_vs_matrix", quat_rotate, "abs"};
+  Check c3 = {"rigid_compose_vs_matrix", rigid, "abs"};
+  Check c3a = {"invert_affine_vs_invert", affine, "abs"};
+  checks->push_back(c1);
+  checks->push_back(c2);
+  checks->push_back(c3);
+  checks->push_back(c3a);
+
+  // camera paths: the ends are the poses given and halfway is a unit
+  // quaternion as near one as the other
+  double pose_ends = 0, pose_mid = 0;
+  for(unsigned ii = 0; ii < nmatrices; ++ii) {
+    const Vector4& va = inputs.vectors[ii];
+    const Vector4& vb = inputs.vectors[nmatrices - 1 - ii];
+    CameraPose a(Vector(va.x, va.y, va.z), inputs.quats[ii]);
+    CameraPose b(Vector(vb.x, vb.y, vb.z), inputs.quats[nmatrices - 1 - ii]);
+
+    // slerp may return -b, the same rotation, so compare matrices
+    CameraPose p0 = CameraPose::interpolate(a, b, 0);
+    CameraPose p1 = CameraPose::interpolate(a, b, 1);
+    pose_ends = std::max(pose_ends, (double)(p0.pos + -a.pos).mag());
+    pose_ends = std::max(pose_ends, (double)(p1.pos + -b.pos).mag());
+    pose_ends = std::max(pose_ends, max_abs_diff(p0.orientation.matrix(), a.orientation.matrix()));
+    pose_ends = std::max(pose_ends, max_abs_diff(p1.orientation.matrix(), b.orientation.matrix()));
+
+    Quaternion mid = CameraPose::interpolate(a, b, 0.5f).orientation;
+    pose_mid = std::max(pose_mid, (double)fabsf(mid.magnitude() - 1));
+    pose_mid = std::max(pose_mid, (double)fabsf(fabsf(mid.dot(a.orientation)) -
+                                               fabsf(mid.dot(b.orientation))));
+  }
+  Check c3b = {"camera_pose_endpoints", pose_ends, "abs"};
+  Check c3c = {"camera_pose_midpoint", pose_mid, "abs"};
+  checks->push_back(c3b);
+  checks->push_back(c3c);
+
+  // the batched geodetic conversions against the scalar ones
+  const GeodeticArray& g = inputs.geo;
+  double to_ecef = 0, to_geo = 0;
+  geodetic_to_ecef(g, &inputs.ecef_out);
+  ecef_to_geodetic(inputs.ecef, &inputs.geo_out);
+  for(unsigned ii = 0; ii < g.size(); ++ii) {
+    Point p = Point::fromLatLon(g.lat[ii], g.lon[ii], g.h[ii]);
+    to_ecef = std::max(to_ecef, (double)(inputs.ecef_out[ii] + -p).mag());
+
+    double lat, lon, h;
+    inputs.ecef[ii].toLatLon(&lat, &lon, &h);
+    double dlon = fabs(inputs.geo_out.lon[ii] - lon);
+    if(dlon > M_PI) dlon = 2 * M_PI - dlon;
+    to_geo = std::max(to_geo, fabs(inputs.geo_out.lat[ii] - lat));
+    to_geo = std::max(to_geo, dlon * cos(lat));
+    to_geo = std::max(to_geo, fabs(inputs.geo_out.h[ii] - h));
+  }
+  Check c4 = {"geodetic_to_ecef_error", to_ecef * meters, "m"};
+  Check c5 = {"ecef_to_geodetic_error", to_geo * meters, "m"};
+  checks->push_back(c4);
+  checks->push_back(c5);
+
+  // haversine against vincenty, and the pruned vincenty search against
+  // trying every pair
+  std::vector<float> hav, vin, all;
+  geodesic_pairs(GEODESIC_HAVERSINE, inputs.geo_a, inputs.geo_b, &hav, NULL);
+  geodesic_pairs(GEODESIC_VINCENTY, inputs.geo_a, inputs.geo_b, &vin, NULL);
+  double rel = 0;
+  for(unsigned ii = 0; ii < hav.size(); ++ii) {
+    rel = std::max(rel, fabs(hav[ii] - vin[ii]) / (vin[ii] + 1e-9));
+  }
+  Check c6 = {"haversine_vs_vincenty", rel * 100, "%"};
+  checks->push_back(c6);
+
+  const GeodeticArray& a = inputs.geo_q;
+  const GeodeticArray& b = inputs.geo_b;
+  std::vector<unsigned> index;
+  geodesic_nearest(GEODESIC_VINCENTY, a, b, &index, &vin);
+  geodesic_all_pairs(GEODESIC_VINCENTY, a, b, &all, NULL);
+  unsigned wrong = 0;
+  for(unsigned ii = 0; ii < a.size(); ++ii) {
+    if(*std::min_element(all.begin() + ii * b.size(), all.begin() + (ii + 1) * b.size()) != vin[ii]) {
+      wrong++;
+    }
+  }
+  Check c7 = {"vincenty_nearest_mismatches", double(wrong), "count"};
+  checks->push_back(c7);
+}
+
+typedef enum {
+  FORMAT_TEXT,
+  FORMAT_CSV,
+  FORMAT_JSON
+} Format;
+
+static void print_results(Format format, const std::vector<Result>& results,
+                          const std::vector<Check>& checks) {
+  const char* kernels = matrix_kernels()->name;
+
+  if(format == FORMAT_TEXT) {
+    printf("matrix kernels: %s\n\n", kernels);
+    printf("%-28s %9s %7s %9s %9s %9s %9s %9s %9s %12s\n", "benchmark (ns/item)", "items",
+           "threads", "min", "median", "mean", "stddev", "p95", "ticks", "Mitems/s/core");
+    for(unsigned ii = 0; ii < results.size(); ++ii) {
+      const Result& r = results[ii];
+      printf("%-28s %9u %7u %9.3f %9.3f %9.3f %9.3f %9.3f %9.2f %12.3f\n", r.name.c_str(),
+             r.items, r.threads, r.min, r.median, r.mean, r.stddev, r.p95, r.ticks,
+             mitems_per_core(r));
+    }
+    if(!checks.empty()) printf("\n%-28s %12s\n", "check", "value");
+    for(unsigned ii = 0; ii < checks.size(); ++ii) {
+      printf("%-28s %12.6g %s\n", checks[ii].name.c_str(), checks[ii].value, checks[ii].unit);
+    }
+  } else if(format == FORMAT_CSV) {
+    printf("kind,name,kernels,items,threads,min_ns,median_ns,mean_ns,stddev_ns,p95_ns,ticks,"
+           "mitems_per_s_per_core,value,unit\n");
+    for(unsigned ii = 0; ii < results.size(); ++ii) {
+      const Result& r = results[ii];
+      printf("bench,%s,%s,%u,%u,%.4f,%.4f,%.4f,%.4f,%.4f,%.3f,%.4f,,\n", r.name.c_str(),
+             kernels, r.items, r.threads, r.min, r.median, r.mean, r.stddev, r.p95, r.ticks,
+             mitems_per_core(r));
+    }
+    for(unsigned ii = 0; ii < checks.size(); ++ii) {
+      printf("check,%s,%s,,,,,,,,,,%.9g,%s\n", checks[ii].name.c_str(), kernels,
+             checks[ii].value, checks[ii].unit);
+    }
+  } else {
+    printf("{\n  \"kernels\": \"%s\",\n  \"benchmarks\": [", kernels);
+    for(unsigned ii = 0; ii < results.size(); ++ii) {
+      const Result& r = results[ii];
+      printf("%s\n    {\"name\": \"%s\", \"items\": %u, \"threads\": %u, \"min_ns\": %.4f, "
+             "\"median_ns\": %.4f, \"mean_ns\": %.4f, \"stddev_ns\": %.4f, \"p95_ns\": %.4f, "
+             "\"ticks\": %.3f, \"mitems_per_s_per_core\": %.4f}",
+             ii ? "," : "", r.name.c_str(), r.items, r.threads, r.min, r.median, r.mean,
+             r.stddev, r.p95, r.ticks, mitems_per_core(r));
+    }
+    printf("\n  ],\n  \"checks\": [");
+    for(unsigned ii = 0; ii < checks.size(); ++ii) {
+      printf("%s\n    {\"name\": \"%s\", \"value\": %.9g, \"unit\": \"%s\"}",
+             ii ? "," : "", checks[ii].name.c_str(), checks[ii].value, checks[ii].unit);
+    }
+    printf("\n  ]\n}\n");
+  }
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "usage: %s [--format text|csv|json] [--no-checks] [--threads N] [name filter]\n"
+          "  runs the benchmarks whose names contain the filter, all by default\n"
+          "  --threads sizes the pool of the _pooled ones, one per cpu by default\n", prog);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  Format format = FORMAT_TEXT;
+  bool checks_wanted = true;
+  unsigned nthreads = ThreadPool::default_size();
+
+  static const struct option options[] = {
+    {"format", required_argument, NULL, 'f'},
+    {"no-checks", no_argument, NULL, 'n'},
+    {"threads", required_argument, NULL, 'j'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int opt;
+  while((opt = getopt_long(argc, argv, "f:nj:", options, NULL)) != -1) {
+    switch(opt) {
+    case 'f':
+      if(strcmp(optarg, "text") == 0) format = FORMAT_TEXT;
+      else if(strcmp(optarg, "csv") == 0) format = FORMAT_CSV;
+      else if(strcmp(optarg, "json") == 0) format = FORMAT_JSON;
+      else usage(argv[0]);
+      break;
+    case 'n': checks_wanted = false; break;
+    case 'j':
+      nthreads = atoi(optarg);
+      if(nthreads < 1) usage(argv[0]);
+      break;
+    default: usage(argv[0]);
+    }
+  }
+  const char* filter = optind < argc ? argv[optind] : NULL;
+
+  make_inputs(&inputs);
+
+  std::vector<Result> results;
+  for(unsigned ii = 0; ii < sizeof(benchmarks) / sizeof(benchmarks[0]); ++ii) {
+    const Benchmark& b = benchmarks[ii];
+    if(filter && !strstr(b.name, filter)) continue;
+    results.push_back(measure(b.name, b.items, 1, b.fn, NULL));
+  }
+
+  ThreadPool pool(nthreads);
+  for(unsigned ii = 0; ii < sizeof(pooled_benchmarks) / sizeof(pooled_benchmarks[0]); ++ii) {
+    const Benchmark& b = pooled_benchmarks[ii];
+    if(filter && !strstr(b.name, filter)) continue;
+    results.push_back(measure(b.name, b.items, pool.size(), b.fn, &pool));
+  }
+
+  std::vector<Check> checks;
+  if(checks_wanted) run_checks(&checks);
+
+  print_results(format, results, checks);
+  return 0;
+}
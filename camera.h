@@ -2,6 +2,7 @@
 #define CAMERA_H
 
 #include "point.h"
+#include "transform.h"
 
 inline float d2r(float deg) {
   return deg * M_PI / 180.0f;
@@ -11,20 +12,53 @@ inline float r2d(float rad) {
   return rad * 180.0f / M_PI;
 }
 
-class Camera {
+// frustum planes as (nx, ny, nz, d) with unit normals pointing in, so a
+// world point p is inside a plane when n.p + d >= 0
+typedef enum {
+  FRUSTUM_LEFT,
+  FRUSTUM_RIGHT,
+  FRUSTUM_BOTTOM,
+  FRUSTUM_TOP,
+  FRUSTUM_NEAR,
+  FRUSTUM_FAR,
+  FRUSTUM_PLANES
+} FrustumPlane;
+
+// where a camera is and which way it faces, for moving it along paths
+class CameraPose {
 public:
-  Vector look;
-  Vector up;
   Vector pos;
+  Quaternion orientation;
 
-  float fov;
-  float aspect;
-  float zmin;
-  float zmax;
+  inline CameraPose() {
+  }
+
+  inline CameraPose(const Vector& pos, const Quaternion& orientation)
+    : pos(pos), orientation(orientation) {
+  }
+
+  // position moves in a straight line and orientation by slerp
+  inline static CameraPose interpolate(const CameraPose& a, const CameraPose& b, float t) {
+    return CameraPose(a.pos * (1 - t) + b.pos * t,
+                      Quaternion::slerp(a.orientation, b.orientation, t));
+  }
+};
 
+// the view, projection, their product and all their inverses are kept
+// and only rebuilt when something they depend on changes, which is why
+// the camera's state is only changed through its methods.
+//
+// orientation is a unit quaternion taking the camera's local axes (x
+// right, y up, looking down -z) to the world. rotations compose onto it
+// directly so the basis never drifts out of orthonormal, and look and
+// up are derived from it whenever it changes.
+class Camera {
+public:
   inline Camera(float fov, float aspect, float zmin, float zmax)
     : look(Vector(0,0,-1)), up(Vector(0,1,0)), pos(Vector(0,0,0)),
-      fov(fov), aspect(aspect), zmin(zmin), zmax(zmax) {
+      fov(fov), aspect(aspect), zmin(zmin), zmax(zmax),
+      window_left(0), window_bottom(0), window_right(1), window_top(1),
+      dirty(VIEW_DIRTY | PROJECTION_DIRTY) {
   }
 
   inline const Vector& axisZ() const {
@@ -39,6 +73,134 @@ public:
     return look.cross(up); //up.cross(look);
   }
 
+  inline const Vector& getPosition() const {
+    return pos;
+  }
+
+  inline float getAspect() const {
+    return aspect;
+  }
+
+  inline const Quaternion& getOrientation() const {
+    return orientation;
+  }
+
+  inline CameraPose getPose() const {
+    return CameraPose(pos, orientation);
+  }
+
+  inline void setPosition(const Vector& p) {
+    if(p.x != pos.x || p.y != pos.y || p.z != pos.z) {
+      pos = p;
+      dirty |= VIEW_DIRTY;
+    }
+  }
+
+  inline void setOrientation(const Quaternion& q) {
+    if(q.w != orientation.w || q.x != orientation.x ||
+       q.y != orientation.y || q.z != orientation.z) {
+      orientation = q;
+      orientation.normalize();
+      updateAxes();
+    }
+  }
+
+  // up needn't be perpendicular to look, only not parallel to it
+  inline void setOrientation(const Vector& new_look, const Vector& new_up) {
+    if(new_look.x != look.x || new_look.y != look.y || new_look.z != look.z ||
+       new_up.x != up.x || new_up.y != up.y || new_up.z != up.z) {
+      Vector z = -new_look.norm();
+      Vector x = new_up.cross(z).norm();
+      setOrientation(Quaternion::fromAxes(x, z.cross(x), z));
+    }
+  }
+
+  inline void setPose(const CameraPose& pose) {
+    setPosition(pose.pos);
+    setOrientation(pose.orientation);
+  }
+
+  inline void setFov(float new_fov) {
+    if(new_fov != fov) {
+      fov = new_fov;
+      dirty |= PROJECTION_DIRTY;
+    }
+  }
+
+  inline void setAspect(float new_aspect) {
+    if(new_aspect != aspect) {
+      aspect = new_aspect;
+      dirty |= PROJECTION_DIRTY;
+    }
+  }
+
+  // restrict the projection to the piece of the full view between the
+  // given fractions of its width and height, (0,0) being bottom
+  // left. see getTileTransform.
+  inline void setWindow(double left, double bottom, double right, double top) {
+    if(left != window_left || bottom != window_bottom ||
+       right != window_right || top != window_top) {
+      window_left = left;
+      window_bottom = bottom;
+      window_right = right;
+      window_top = top;
+      dirty |= PROJECTION_DIRTY;
+    }
+  }
+
+  inline const Rigid<float>& getView() {
+    update();
+    return view;
+  }
+
+  inline const Matrix& getViewMatrix() {
+    update();
+    return view_matrix;
+  }
+
+  inline const Matrix& getViewInverse() {
+    update();
+    return view_inverse;
+  }
+
+  inline const Matrix& getProjection() {
+    update();
+    return projection;
+  }
+
+  inline const Matrix& getProjectionInverse() {
+    update();
+    return projection_inverse;
+  }
+
+  inline const Matrix& getViewProjection() {
+    update();
+    return view_projection;
+  }
+
+  inline const Matrix& getViewProjectionInverse() {
+    update();
+    return view_projection_inverse;
+  }
+
+  // indexed by FrustumPlane
+  inline const Vector4* getFrustumPlanes() {
+    update();
+    return planes;
+  }
+
+  // false only when the sphere is entirely outside the frustum
+  inline bool sphereVisible(const Point& center, float radius) {
+    update();
+    for(unsigned ii = 0; ii < FRUSTUM_PLANES; ++ii) {
+      const Vector4& p = planes[ii];
+      if(p.x * center.x + p.y * center.y + p.z * center.z + p.w < -radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+
   inline Matrix getMatrix(bool rotationOnly = false) const {
     Matrix result;
     result.set_column(0, axisX());
@@ -49,75 +211,69 @@ public:
     return result;
   }
 
-  inline Matrix getWorldToCamera(bool rotationOnly = false) const {
-    Matrix result;
-
-    Vector z = -axisZ();
-    Vector y = axisY();
-    Vector x = y.cross(z);
-
-    result.set_row(0, x);
-    result.set_row(1, y);
-    result.set_row(2, z);
+  // the view as a rotation and translation, which inverts and composes
+  // for much less than a Matrix
+  inline Rigid<float> getWorldToCameraRigid(bool rotationOnly = false) const {
+    Vec3<float> z = -axisZ();
+    Vec3<float> y = axisY();
+    Vec3<float> x = y.cross(z);
 
+    // the basis goes in the rows
+    Mat3<float> r = Mat3<float>(x, y, z).transpose();
     if(rotationOnly) {
-      return result;
+      return Rigid<float>(r, Vec3<float>());
     } else {
-      return result * Matrix::translation(-pos.x, -pos.y, -pos.z);
+      return Rigid<float>(r, r * -Vec3<float>(pos));
     }
   }
 
+  inline Matrix getWorldToCamera(bool rotationOnly = false) const {
+    return getWorldToCameraRigid(rotationOnly).matrix();
+  }
+
   void moveForward(float delta) {
+    if(delta == 0) return;
     pos = pos + look * delta;
+    dirty |= VIEW_DIRTY;
   }
 
   void moveUp(float delta) {
+    if(delta == 0) return;
     pos = pos + up * delta;
+    dirty |= VIEW_DIRTY;
   }
 
   void moveRight(float delta) {
+    if(delta == 0) return;
     pos = pos + axisX() * delta;
+    dirty |= VIEW_DIRTY;
   }
 
+  // rotations about the camera's own axes compose on the right
   inline void rotateZ(float angle) {
-    Matrix m;
-    m.set_rotation(angle, axisZ());
-    up = m * up;
+    rotateLocal(angle, Vector(0, 0, -1));
   }
 
   inline void rotateY(float angle) {
-    Matrix m;
-    m.set_rotation(angle, axisY());
-    look = m * look;
+    rotateLocal(angle, Vector(0, 1, 0));
   }
 
   inline void rotateX(float angle) {
-    Matrix m;
-    m.set_rotation(angle, axisX());
-    look = m * look;
-    up = m * up;
-  }
-
-  inline void normalize() {
-    look = look.norm();
-    up = up.norm();
+    rotateLocal(angle, Vector(1, 0, 0));
   }
 
   inline void forceUp(const Vector& suggested_up) {
-    // renormalize our vectors in a way that removes roll and puts the
-    // up vector in the world up/look plane.
-    look = look.norm();
-
+    // removes roll and puts the up vector in the world up/look plane.
     if(fabs(look.dot(suggested_up)) > 0.8) {
-      Vector right = look.cross(up.norm());
-      up = right.cross(look);
+      Vector right = look.cross(up);
+      setOrientation(look, right.cross(look));
     } else {
       Vector right = look.cross(suggested_up);
-      up = right.cross(look);
+      setOrientation(look, right.cross(look));
     }
   }
 
-  inline Matrix getPerspectiveTransform() {
+  inline Matrix getPerspectiveTransform() const {
     /*
     Matrix result;
     float f = 1.0f / tan(fov/2);
@@ -131,14 +287,28 @@ public:
     return result;
     */
 
-    Matrix result;
-    result.set_identity();
-
     float ymax = zmin * tanf(fov * 0.5f);
     float ymin = -ymax;
     float xmin = ymin * aspect;
     float xmax = -xmin;
 
+    return getFrustum(xmin, xmax, ymin, ymax);
+  }
+
+  // the off-center piece of the full view between the given fractions
+  // of its width and height, (0,0) being bottom left. rendering an
+  // image in tiles with these gives the same pixels as rendering it
+  // whole.
+  inline Matrix getTileTransform(double left, double bottom, double right, double top) const {
+    float bounds[4];
+    getTileBounds(left, bottom, right, top, bounds);
+    return getFrustum(bounds[0], bounds[1], bounds[2], bounds[3]);
+  }
+
+  inline Matrix getFrustum(float xmin, float xmax, float ymin, float ymax) const {
+    Matrix result;
+    result.set_identity();
+
     result.data[0] = (2.0f * zmin) / (xmax - xmin);
     result.data[5] = (2.0f * zmin) / (ymax - ymin);
     result.data[8] = (xmax + xmin) / (xmax - xmin);
@@ -149,6 +319,112 @@ public:
     result.data[15] = 0.0f;
     return result;
   }
+
+  // the inverse of getFrustum worked out by hand. x and y only depend
+  // on themselves and on z, so it's a handful of divides.
+  inline Matrix getFrustumInverse(float xmin, float xmax, float ymin, float ymax) const {
+    Matrix f = getFrustum(xmin, xmax, ymin, ymax);
+    Matrix result;
+
+    result.data[0] = 1.0f / f.data[0];
+    result.data[5] = 1.0f / f.data[5];
+    result.data[10] = 0.0f;
+    result.data[11] = 1.0f / f.data[14];
+    result.data[12] = f.data[8] / f.data[0];
+    result.data[13] = f.data[9] / f.data[5];
+    result.data[14] = -1.0f;
+    result.data[15] = f.data[10] / f.data[14];
+    return result;
+  }
+
+private:
+  enum {
+    VIEW_DIRTY = 1,
+    PROJECTION_DIRTY = 2
+  };
+
+  inline void rotateLocal(float angle, const Vector& axis) {
+    orientation = orientation * Quaternion::rotation(angle, axis);
+    // one sqrt keeps the length from creeping away from 1
+    orientation.normalize();
+    updateAxes();
+  }
+
+  inline void updateAxes() {
+    look = orientation * Vector(0, 0, -1);
+    up = orientation * Vector(0, 1, 0);
+    dirty |= VIEW_DIRTY;
+  }
+
+  // xmin, xmax, ymin, ymax on the near plane of a piece of the view
+  inline void getTileBounds(double left, double bottom, double right, double top,
+                            float* bounds) const {
+    float ymax = zmin * tanf(fov * 0.5f);
+    float ymin = -ymax;
+    float xmin = ymin * aspect;
+    float xmax = -xmin;
+
+    double w = double(xmax) - xmin;
+    double h = double(ymax) - ymin;
+    bounds[0] = float(xmin + w * left);
+    bounds[1] = float(xmin + w * right);
+    bounds[2] = float(ymin + h * bottom);
+    bounds[3] = float(ymin + h * top);
+  }
+
+  inline void update() {
+    if(!dirty) return;
+
+    if(dirty & VIEW_DIRTY) {
+      view = getWorldToCameraRigid();
+      view_matrix = view.matrix();
+      view_inverse = view.inverse().matrix();
+    }
+
+    if(dirty & PROJECTION_DIRTY) {
+      float b[4];
+      getTileBounds(window_left, window_bottom, window_right, window_top, b);
+      projection = getFrustum(b[0], b[1], b[2], b[3]);
+      projection_inverse = getFrustumInverse(b[0], b[1], b[2], b[3]);
+    }
+
+    view_projection = projection * view_matrix;
+    view_projection_inverse = view_inverse * projection_inverse;
+
+    // each plane is the w row plus or minus one of the others
+    const Matrix& m = view_projection;
+    for(unsigned ii = 0; ii < FRUSTUM_PLANES; ++ii) {
+      unsigned row = ii / 2;
+      float sign = (ii % 2) ? -1.0f : 1.0f;
+      Vector n(m.elm(3,0) + sign * m.elm(row,0),
+               m.elm(3,1) + sign * m.elm(row,1),
+               m.elm(3,2) + sign * m.elm(row,2));
+      float d = m.elm(3,3) + sign * m.elm(row,3);
+      float len = n.mag();
+      planes[ii] = Vector4(n.x / len, n.y / len, n.z / len, d / len);
+    }
+
+    dirty = 0;
+  }
+
+  Quaternion orientation;
+  Vector look;
+  Vector up;
+  Vector pos;
+
+  float fov;
+  float aspect;
+  float zmin;
+  float zmax;
+
+  double window_left, window_bottom, window_right, window_top;
+
+  unsigned dirty;
+  Rigid<float> view;
+  Matrix view_matrix, view_inverse;
+  Matrix projection, projection_inverse;
+  Matrix view_projection, view_projection_inverse;
+  Vector4 planes[FRUSTUM_PLANES];
 };
 
 #endif
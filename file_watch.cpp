@@ -0,0 +1,76 @@
+#include "file_watch.h"
+#include "utils.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+// "dir/name" for path, with "." as the directory of a bare name
+static void split_path(const std::string& path, std::string* dir, std::string* name) {
+  size_t slash = path.rfind('/');
+  if(slash == std::string::npos) {
+    *dir = ".";
+    *name = path;
+  } else {
+    *dir = slash == 0 ? "/" : path.substr(0, slash);
+    *name = path.substr(slash + 1);
+  }
+}
+
+FileWatcher::FileWatcher()
+  : fd(-1) {
+#ifdef __linux__
+  fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if(fd < 0) {
+    LOGW("inotify_init1: %s, not watching files", strerror(errno));
+  }
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+  if(fd >= 0) close(fd);
+}
+
+void FileWatcher::watch(const std::string& path) {
+  if(fd < 0) return;
+#ifdef __linux__
+  std::string dir, name;
+  split_path(path, &dir, &name);
+
+  // the same directory always comes back with the same descriptor
+  int wd = inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+  if(wd < 0) {
+    LOGW("inotify_add_watch %s: %s", dir.c_str(), strerror(errno));
+    return;
+  }
+  dirs[wd] = dir;
+  files[dir + "/" + name] = path;
+#endif
+}
+
+void FileWatcher::changed(std::set<std::string>* paths) {
+  if(fd < 0) return;
+#ifdef __linux__
+  char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  while(true) {
+    ssize_t len = read(fd, buffer, sizeof(buffer));
+    if(len <= 0) break; // EAGAIN once it's drained
+
+    for(char* ptr = buffer; ptr < buffer + len; ) {
+      const struct inotify_event* event = (const struct inotify_event*)ptr;
+      ptr += sizeof(struct inotify_event) + event->len;
+      if(!event->len) continue;
+
+      std::map<int, std::string>::iterator dir = dirs.find(event->wd);
+      if(dir == dirs.end()) continue;
+      std::map<std::string, std::string>::iterator file =
+        files.find(dir->second + "/" + event->name);
+      if(file != files.end()) paths->insert(file->second);
+    }
+  }
+#endif
+}
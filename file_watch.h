@@ -0,0 +1,33 @@
+#ifndef FILE_WATCH_H
+#define FILE_WATCH_H
+
+#include <map>
+#include <set>
+#include <string>
+
+// reports files that have been written since it last looked, without
+// ever blocking. the directory holding each file is what's watched, so
+// editors that save by writing a new file and renaming it over the old
+// one are seen too.
+//
+// built on inotify, elsewhere active() is false and nothing is ever
+// reported.
+class FileWatcher {
+public:
+  FileWatcher();
+  ~FileWatcher();
+
+  bool active() const { return fd >= 0; }
+
+  void watch(const std::string& path);
+
+  // adds the paths that changed, as they were given to watch
+  void changed(std::set<std::string>* paths);
+
+private:
+  int fd;
+  std::map<int, std::string> dirs;            // watch descriptor to directory
+  std::map<std::string, std::string> files;   // directory/name to the watched path
+};
+
+#endif
@@ -0,0 +1,273 @@
+#include "frame_sink.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdlib.h>
+
+static const uint64_t fnv_offset = 14695981039346656037ULL;
+static const uint64_t fnv_prime = 1099511628211ULL;
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+  const unsigned char* bytes = (const unsigned char*)data;
+  for(size_t ii = 0; ii < len; ++ii) {
+    hash = (hash ^ bytes[ii]) * fnv_prime;
+  }
+  return hash;
+}
+
+FrameSink::FrameSink(const char* prefix)
+  : prefix(prefix), to_stdout(strcmp(prefix, "-") == 0), manifest_fd(-1),
+    f(NULL), frame(0), w(0), h(0), size(0), hash(fnv_offset),
+    dedup(false), threshold(0), have_reference(false), ref_frame(0),
+    ref_size(0), ref_hash(0), ref_f(NULL), unchanged(false), nwritten(0), nlinked(0) {
+}
+
+FrameSink::~FrameSink() {
+  if(manifest_fd >= 0) close(manifest_fd);
+  if(ref_f) fclose(ref_f);
+
+  if(dedup && nlinked > 0) {
+    LOGI("%u of %u frames were unchanged and linked", nlinked, nlinked + nwritten);
+  }
+}
+
+void FrameSink::skip_unchanged(unsigned threshold) {
+  if(to_stdout) fail_exit("unchanged frames can't be skipped on stdout");
+
+  dedup = true;
+  this->threshold = threshold;
+}
+
+std::string FrameSink::frame_name(unsigned frame) const {
+  return stdstring("%s_%06d.ppm", prefix.c_str(), frame);
+}
+
+void FrameSink::load_manifest() {
+  if(to_stdout) return;
+
+  std::string mname = prefix + ".manifest";
+  FILE* mf = fopen(mname.c_str(), "r");
+  if(!mf) return;
+
+  unsigned mframe;
+  Entry entry;
+  while(fscanf(mf, "%u %ld %" SCNx64, &mframe, &entry.size, &entry.hash) == 3) {
+    completed[mframe] = entry;
+  }
+  fclose(mf);
+
+  LOGI("%s lists %d completed frames", mname.c_str(), (int)completed.size());
+}
+
+bool FrameSink::is_done(unsigned frame) {
+  Entries::iterator iter = completed.find(frame);
+  if(iter == completed.end()) return false;
+
+  std::string fname = frame_name(frame);
+  FILE* ff = fopen(fname.c_str(), "rb");
+  if(!ff) return false;
+
+  uint64_t fhash = fnv_offset;
+  long fsize = 0;
+  char buffer[64 * 1024];
+  size_t nread;
+  while((nread = fread(buffer, 1, sizeof(buffer), ff)) > 0) {
+    fhash = fnv1a(fhash, buffer, nread);
+    fsize += nread;
+  }
+  fclose(ff);
+
+  if(fsize != iter->second.size || fhash != iter->second.hash) {
+    LOGW("%s doesn't match the manifest, rendering it again", fname.c_str());
+    completed.erase(iter);
+    return false;
+  }
+
+  return true;
+}
+
+void FrameSink::write(const void* data, size_t len) {
+  if(fwrite(data, len, 1, f) != 1) {
+    fail_exit("failed writing frame %u: %s", frame, strerror(errno));
+  }
+  hash = fnv1a(hash, data, len);
+  size += len;
+}
+
+void FrameSink::write_header() {
+  char header[64];
+  int len = snprintf(header, sizeof(header), "P6\n%d %d 255\n", w, h);
+  write(header, len);
+}
+
+void FrameSink::open_frame() {
+  size = 0;
+  hash = fnv_offset;
+
+  if(to_stdout) {
+    f = stdout;
+  } else {
+    // write under a temporary name so a crash never leaves a partial
+    // frame behind the final name
+    std::string tmpname = frame_name(frame) + ".tmp";
+    f = fopen(tmpname.c_str(), "wb");
+    if(!f) fail_exit("couldn't write to %s", tmpname.c_str());
+  }
+
+  write_header();
+}
+
+void FrameSink::close_frame() {
+  if(to_stdout) {
+    fflush(f);
+    f = NULL;
+    return;
+  }
+
+  if(fclose(f) != 0) fail_exit("failed writing frame %u: %s", frame, strerror(errno));
+  f = NULL;
+
+  std::string fname = frame_name(frame);
+  std::string tmpname = fname + ".tmp";
+  if(rename(tmpname.c_str(), fname.c_str()) != 0) {
+    fail_exit("couldn't rename %s: %s", tmpname.c_str(), strerror(errno));
+  }
+
+  record(size, hash);
+}
+
+void FrameSink::link_frame() {
+  // link by basename so the output directory can be moved
+  std::string target = frame_name(ref_frame);
+  size_t slash = target.rfind('/');
+  if(slash != std::string::npos) target = target.substr(slash + 1);
+
+  std::string fname = frame_name(frame);
+  std::string tmpname = fname + ".tmp";
+  unlink(tmpname.c_str());
+  if(symlink(target.c_str(), tmpname.c_str()) != 0) {
+    fail_exit("couldn't link %s: %s", tmpname.c_str(), strerror(errno));
+  }
+  if(rename(tmpname.c_str(), fname.c_str()) != 0) {
+    fail_exit("couldn't rename %s: %s", tmpname.c_str(), strerror(errno));
+  }
+
+  // the manifest describes what reading the name gives back
+  record(ref_size, ref_hash);
+}
+
+void FrameSink::record(long size, uint64_t hash) {
+  if(manifest_fd < 0) {
+    std::string mname = prefix + ".manifest";
+    manifest_fd = open(mname.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if(manifest_fd < 0) fail_exit("couldn't open %s: %s", mname.c_str(), strerror(errno));
+  }
+
+  // one short append per frame so workers sharing the manifest never
+  // interleave their lines
+  char line[64];
+  int len = snprintf(line, sizeof(line), "%06u %ld %016" PRIx64 "\n", frame, size, hash);
+  if(::write(manifest_fd, line, len) != len) {
+    fail_exit("failed appending to the manifest: %s", strerror(errno));
+  }
+
+  Entry entry = { size, hash };
+  completed[frame] = entry;
+}
+
+// positions ref_f on the reference's first row, if it has the same
+// header as the frame about to be written
+void FrameSink::open_reference() {
+  unchanged = false;
+  if(!have_reference) return;
+
+  std::string rname = frame_name(ref_frame);
+  ref_f = fopen(rname.c_str(), "rb");
+  if(!ref_f) {
+    LOGW("couldn't read back %s: %s", rname.c_str(), strerror(errno));
+    have_reference = false;
+    return;
+  }
+
+  char header[64], ref_header[64];
+  int len = snprintf(header, sizeof(header), "P6\n%d %d 255\n", w, h);
+  if(fread(ref_header, len, 1, ref_f) != 1 || memcmp(header, ref_header, len) != 0) {
+    fclose(ref_f);
+    ref_f = NULL;
+    return;
+  }
+  unchanged = true;
+}
+
+// once a row differs the rest of the frame needn't be looked at
+void FrameSink::compare_row(const unsigned char* row, size_t len) {
+  ref_row.resize(len);
+  bool same = fread(&ref_row[0], len, 1, ref_f) == 1;
+  if(same && threshold == 0) {
+    same = memcmp(&ref_row[0], row, len) == 0;
+  } else if(same) {
+    for(size_t ii = 0; same && ii < len; ++ii) {
+      same = (unsigned)abs((int)row[ii] - (int)ref_row[ii]) <= threshold;
+    }
+  }
+
+  if(!same) {
+    unchanged = false;
+    fclose(ref_f);
+    ref_f = NULL;
+  }
+}
+
+void FrameSink::begin_frame(unsigned frame, unsigned w, unsigned h) {
+  this->frame = frame;
+  this->w = w;
+  this->h = h;
+
+  open_frame();
+  if(dedup) open_reference();
+}
+
+void FrameSink::write_rows(Image* rows, unsigned nrows) {
+  TRACE_ZONE("write rows");
+  if(rows->ch != 3) fail_exit("cannot write a frame that doesn't have 3 channels");
+
+  size_t stride = rows->w * rows->ch;
+  for(int ii = (nrows-1); ii >= 0; --ii) {
+    const unsigned char* row = rows->data + ii * stride;
+    write(row, stride);
+    if(ref_f) compare_row(row, stride);
+  }
+}
+
+void FrameSink::end_frame() {
+  TRACE_ZONE("end frame");
+  if(ref_f) {
+    fclose(ref_f);
+    ref_f = NULL;
+  }
+
+  if(dedup && unchanged) {
+    // link_frame puts the symlink where the copy was
+    if(fclose(f) != 0) fail_exit("failed writing frame %u: %s", frame, strerror(errno));
+    f = NULL;
+    link_frame();
+    nlinked++;
+    return;
+  }
+
+  close_frame();
+  nwritten++;
+  if(!dedup) return;
+
+  // later frames are compared against this one, not their immediate
+  // predecessor, so small changes can't creep in a frame at a time
+  have_reference = true;
+  ref_frame = frame;
+  ref_size = size;
+  ref_hash = hash;
+}
@@ -0,0 +1,91 @@
+#ifndef FRAME_SINK_H
+#define FRAME_SINK_H
+
+#include "gl_headers.h"
+#include "image.h"
+
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <vector>
+
+// where rendered frames go. frames are written as ppm, either to
+// <prefix>_<frame>.ppm or all to stdout when the prefix is "-".
+//
+// with files, each completed frame is appended to <prefix>.manifest
+// along with its size and checksum. a later run can load the manifest
+// and skip every frame whose file is still intact.
+//
+// with skip_unchanged, each frame still streams to its file but every
+// row is also compared, as it arrives, against the same row of the last
+// frame actually written, read back from that frame's file. if no
+// channel moved by more than the threshold the finished file is
+// replaced by a symlink to that one.
+class FrameSink {
+public:
+  FrameSink(const char* prefix);
+  ~FrameSink();
+
+  void load_manifest();
+
+  // threshold is the largest per channel difference still considered
+  // unchanged. 0 only links byte identical frames.
+  void skip_unchanged(unsigned threshold);
+
+  // true if the manifest lists the frame and its file still matches
+  bool is_done(unsigned frame);
+
+  void begin_frame(unsigned frame, unsigned w, unsigned h);
+
+  // the next nrows rows of the frame from an image holding them bottom
+  // row first, the way GL reads them back
+  void write_rows(Image* rows, unsigned nrows);
+
+  void end_frame();
+
+private:
+  struct Entry {
+    long size;
+    uint64_t hash;
+  };
+  typedef std::map<unsigned, Entry> Entries;
+
+  void write(const void* data, size_t len);
+  void write_header();
+  void open_frame();
+  void close_frame();
+  void link_frame();
+  void record(long size, uint64_t hash);
+  void open_reference();
+  void compare_row(const unsigned char* row, size_t len);
+  std::string frame_name(unsigned frame) const;
+
+  std::string prefix;
+  bool to_stdout;
+  int manifest_fd;
+  Entries completed;
+
+  FILE* f;
+  unsigned frame;
+  unsigned w, h;
+  long size;
+  uint64_t hash;
+
+  bool dedup;
+  unsigned threshold;
+
+  // the last frame we wrote out in full. ref_f reads it alongside the
+  // frame being written, for as long as they still match.
+  bool have_reference;
+  unsigned ref_frame;
+  long ref_size;
+  uint64_t ref_hash;
+  FILE* ref_f;
+  bool unchanged;
+  std::vector<unsigned char> ref_row;
+
+  unsigned nwritten;
+  unsigned nlinked;
+};
+
+#endif
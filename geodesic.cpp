@@ -0,0 +1,435 @@
+#include "geodesic.h"
+#include "simd_math.h"
+
+#include <algorithm>
+
+// work items handed to the pool cover about this many pairs
+static const unsigned chunk_size = 16384;
+
+// the ellipsoid in Vincenty's terms, b computed just as fromLatLon does
+static const double major = earth_rn;
+static const double minor = (1 - earth_e*earth_e) * earth_rn;
+static const double flattening = (major - minor) / major;
+
+// the sphere haversine measures on
+static const float mean_radius = float((2 * major + minor) / 3);
+
+// sines and cosines of half of each latitude and longitude. everything
+// haversine needs between two points is products and sums of these,
+// so all pairs of n and m points only take n + m sincos. padded to a
+// multiple of four with zero angles.
+struct HalfAngles {
+  std::vector<float> slat, clat, slon, clon;
+};
+
+static void half_angles(const GeodeticArray& g, HalfAngles* out) {
+  unsigned n = (g.size() + 3) & ~3u;
+  out->slat.resize(n);
+  out->clat.resize(n);
+  out->slon.resize(n);
+  out->clon.resize(n);
+
+  for(unsigned ii = 0; ii < n; ii += 4) {
+    float lat[4] = {0}, lon[4] = {0};
+    for(unsigned kk = 0; kk < 4 && ii + kk < g.size(); ++kk) {
+      lat[kk] = 0.5f * g.lat[ii + kk];
+      lon[kk] = 0.5f * g.lon[ii + kk];
+    }
+
+    f4 s, c;
+    f4_sincos(f4::load(lat), &s, &c);
+    s.store(&out->slat[ii]);
+    c.store(&out->clat[ii]);
+    f4_sincos(f4::load(lon), &s, &c);
+    s.store(&out->slon[ii]);
+    c.store(&out->clon[ii]);
+  }
+}
+
+// the sines and cosines of the reduced latitudes for Vincenty
+struct Reduced {
+  std::vector<double> sinu, cosu, lon;
+};
+
+static void reduced(const GeodeticArray& g, Reduced* out) {
+  out->sinu.resize(g.size());
+  out->cosu.resize(g.size());
+  out->lon.resize(g.size());
+  for(unsigned ii = 0; ii < g.size(); ++ii) {
+    out->sinu[ii] = sin(double(g.lat[ii]));
+    out->cosu[ii] = cos(double(g.lat[ii]));
+    out->lon[ii] = g.lon[ii];
+  }
+}
+
+// four lanes of one point against four of another
+struct Half4 {
+  f4 slat, clat, slon, clon;
+
+  inline static Half4 load(const HalfAngles& h, unsigned ii) {
+    Half4 r;
+    r.slat = f4::load(&h.slat[ii]);
+    r.clat = f4::load(&h.clat[ii]);
+    r.slon = f4::load(&h.slon[ii]);
+    r.clon = f4::load(&h.clon[ii]);
+    return r;
+  }
+
+  // straight from the angles, for pairs that are only used once
+  inline static Half4 from(const GeodeticArray& g, unsigned ii, unsigned end) {
+    f4 lat, lon;
+    if(ii + 4 <= end) {
+      lat = f4::load(&g.lat[ii]);
+      lon = f4::load(&g.lon[ii]);
+    } else {
+      float tlat[4] = {0}, tlon[4] = {0};
+      std::copy(&g.lat[ii], &g.lat[0] + end, tlat);
+      std::copy(&g.lon[ii], &g.lon[0] + end, tlon);
+      lat = f4::load(tlat);
+      lon = f4::load(tlon);
+    }
+
+    Half4 r;
+    f4_sincos(lat * f4(0.5f), &r.slat, &r.clat);
+    f4_sincos(lon * f4(0.5f), &r.slon, &r.clon);
+    return r;
+  }
+
+  // the same point in every lane
+  inline static Half4 splat(const HalfAngles& h, unsigned ii) {
+    Half4 r;
+    r.slat = f4(h.slat[ii]);
+    r.clat = f4(h.clat[ii]);
+    r.slon = f4(h.slon[ii]);
+    r.clon = f4(h.clon[ii]);
+    return r;
+  }
+};
+
+// sin^2 of half the unit sphere angle between p and q, which orders
+// pairs the same as their distance
+static inline f4 haversine(const Half4& p, const Half4& q) {
+  f4 sdlat = q.slat * p.clat - q.clat * p.slat;
+  f4 sdlon = q.slon * p.clon - q.clon * p.slon;
+  f4 cos_p = p.clat * p.clat - p.slat * p.slat;
+  f4 cos_q = q.clat * q.clat - q.slat * q.slat;
+  f4 h = sdlat * sdlat + cos_p * cos_q * sdlon * sdlon;
+  return f4::min(f4::max(h, f4(0)), f4(1));
+}
+
+static inline f4 haversine_distance(const f4& h) {
+  return f4(2 * mean_radius) * f4_atan2(f4::sqrt(h), f4::sqrt(f4(1) - h));
+}
+
+static inline f4 haversine_bearing(const Half4& p, const Half4& q) {
+  f4 sdlon = q.slon * p.clon - q.clon * p.slon;
+  f4 cdlon = q.clon * p.clon + q.slon * p.slon;
+  f4 cos_p = p.clat * p.clat - p.slat * p.slat;
+  f4 cos_q = q.clat * q.clat - q.slat * q.slat;
+  f4 sin_p = f4(2) * p.slat * p.clat;
+  f4 sin_q = f4(2) * q.slat * q.clat;
+
+  f4 y = f4(2) * sdlon * cdlon * cos_q;
+  f4 x = cos_p * sin_q - sin_p * cos_q * (f4(1) - f4(2) * sdlon * sdlon);
+  return f4_atan2(y, x);
+}
+
+static inline void store_n(const f4& v, float* out, unsigned n) {
+  if(n >= 4) {
+    v.store(out);
+  } else {
+    float lanes[4];
+    v.store(lanes);
+    std::copy(lanes, lanes + n, out);
+  }
+}
+
+static void vincenty(const Reduced& a, unsigned ii, const Reduced& b, unsigned jj,
+                     float* distance, float* bearing) {
+  double sinu1 = a.sinu[ii], cosu1 = a.cosu[ii];
+  double sinu2 = b.sinu[jj], cosu2 = b.cosu[jj];
+  double L = b.lon[jj] - a.lon[ii];
+
+  double lambda = L, sin_lambda, cos_lambda;
+  double sin_sigma, cos_sigma, sigma, cos2_alpha, cos_2sm;
+  double sphere_sigma = 0;
+  bool converged = false;
+  for(unsigned iter = 0; ; ++iter) {
+    sin_lambda = sin(lambda);
+    cos_lambda = cos(lambda);
+
+    double t0 = cosu2 * sin_lambda;
+    double t1 = cosu1 * sinu2 - sinu1 * cosu2 * cos_lambda;
+    sin_sigma = sqrt(t0 * t0 + t1 * t1);
+    if(sin_sigma == 0) {
+      // the same point
+      if(distance) *distance = 0;
+      if(bearing) *bearing = 0;
+      return;
+    }
+
+    cos_sigma = sinu1 * sinu2 + cosu1 * cosu2 * cos_lambda;
+    sigma = atan2(sin_sigma, cos_sigma);
+    // the first pass has lambda = L, which is the angle on the sphere
+    if(iter == 0) sphere_sigma = sigma;
+    double sin_alpha = cosu1 * cosu2 * sin_lambda / sin_sigma;
+    cos2_alpha = 1 - sin_alpha * sin_alpha;
+    // both on the equator
+    cos_2sm = cos2_alpha != 0 ? cos_sigma - 2 * sinu1 * sinu2 / cos2_alpha : 0;
+
+    double C = flattening / 16 * cos2_alpha * (4 + flattening * (4 - 3 * cos2_alpha));
+    double next = L + (1 - C) * flattening * sin_alpha *
+      (sigma + C * sin_sigma * (cos_2sm + C * cos_sigma * (-1 + 2 * cos_2sm * cos_2sm)));
+
+    converged = fabs(next - lambda) < 1e-12;
+    lambda = next;
+    if(converged || iter == 100) break;
+  }
+
+  if(distance) {
+    double u2 = cos2_alpha * (major * major - minor * minor) / (minor * minor);
+    double A = 1 + u2 / 16384 * (4096 + u2 * (-768 + u2 * (320 - 175 * u2)));
+    double B = u2 / 1024 * (256 + u2 * (-128 + u2 * (74 - 47 * u2)));
+    double d_sigma = B * sin_sigma *
+      (cos_2sm + B / 4 * (cos_sigma * (-1 + 2 * cos_2sm * cos_2sm) -
+                          B / 6 * cos_2sm * (-3 + 4 * sin_sigma * sin_sigma) *
+                          (-3 + 4 * cos_2sm * cos_2sm)));
+    double s = minor * A * (sigma - d_sigma);
+
+    // nearly antipodal pairs can oscillate forever. their last iterate
+    // is at least kept within what the sphere allows, see run_nearest.
+    if(!converged) {
+      s = std::max(minor * sphere_sigma, std::min(major * sphere_sigma, s));
+    }
+    *distance = float(s);
+  }
+
+  if(bearing) {
+    *bearing = float(atan2(cosu2 * sin_lambda, cosu1 * sinu2 - sinu1 * cosu2 * cos_lambda));
+  }
+}
+
+typedef enum {
+  JOB_PAIRS,
+  JOB_ALL_PAIRS,
+  JOB_NEAREST
+} JobKind;
+
+struct GeodesicJob {
+  JobKind kind;
+  GeodesicMethod method;
+  unsigned na, nb;
+
+  // pairs per work item for JOB_PAIRS, rows of a otherwise
+  unsigned per_item;
+
+  const GeodeticArray* a;
+  const GeodeticArray* b;
+  HalfAngles ha, hb;
+  Reduced ra, rb;
+
+  float* distance;
+  float* bearing;
+  unsigned* index;
+};
+
+static void run_pairs(const GeodesicJob* job, unsigned start, unsigned end) {
+  if(job->method == GEODESIC_VINCENTY) {
+    for(unsigned ii = start; ii < end; ++ii) {
+      vincenty(job->ra, ii, job->rb, ii,
+               job->distance ? job->distance + ii : NULL,
+               job->bearing ? job->bearing + ii : NULL);
+    }
+    return;
+  }
+
+  for(unsigned ii = start; ii < end; ii += 4) {
+    Half4 p = Half4::from(*job->a, ii, end), q = Half4::from(*job->b, ii, end);
+    if(job->distance) store_n(haversine_distance(haversine(p, q)), job->distance + ii, end - ii);
+    if(job->bearing) store_n(haversine_bearing(p, q), job->bearing + ii, end - ii);
+  }
+}
+
+static void run_row(const GeodesicJob* job, unsigned ii) {
+  unsigned nb = job->nb;
+  float* distance = job->distance ? job->distance + (size_t)ii * nb : NULL;
+  float* bearing = job->bearing ? job->bearing + (size_t)ii * nb : NULL;
+
+  if(job->method == GEODESIC_VINCENTY) {
+    for(unsigned jj = 0; jj < nb; ++jj) {
+      vincenty(job->ra, ii, job->rb, jj,
+               distance ? distance + jj : NULL, bearing ? bearing + jj : NULL);
+    }
+    return;
+  }
+
+  Half4 p = Half4::splat(job->ha, ii);
+  for(unsigned jj = 0; jj < nb; jj += 4) {
+    Half4 q = Half4::load(job->hb, jj);
+    if(distance) store_n(haversine_distance(haversine(p, q)), distance + jj, nb - jj);
+    if(bearing) store_n(haversine_bearing(p, q), bearing + jj, nb - jj);
+  }
+}
+
+static void run_nearest(const GeodesicJob* job, unsigned ii) {
+  unsigned nb = job->nb;
+  Half4 p = Half4::splat(job->ha, ii);
+
+  // the smallest haversine, checking lanes one by one only when some
+  // lane of a block beats it. padded lanes are skipped there.
+  float best = 2;
+  unsigned best_index = 0;
+  for(unsigned jj = 0; jj < nb; jj += 4) {
+    f4 h = haversine(p, Half4::load(job->hb, jj));
+    if(!(h < f4(best)).any()) continue;
+
+    for(unsigned kk = 0; kk < 4 && jj + kk < nb; ++kk) {
+      if(h[kk] < best) {
+        best = h[kk];
+        best_index = jj + kk;
+      }
+    }
+  }
+
+  float sigma = 2 * atan2f(sqrtf(best), sqrtf(1 - best));
+  if(job->method == GEODESIC_HAVERSINE) {
+    job->index[ii] = best_index;
+    if(job->distance) job->distance[ii] = mean_radius * sigma;
+    return;
+  }
+
+  // the ellipsoid is the unit sphere scaled by major in x and y and
+  // minor in z, so a path's length there is between minor and major
+  // times its length on the sphere. a b further than major * sigma /
+  // minor on the sphere can't be nearer on the ellipsoid than the one
+  // we found, which leaves only a few for Vincenty.
+  float limit = std::min(float(M_PI), float(sigma * major / minor) + 1e-6f);
+  float limit_h = sinf(limit / 2) * sinf(limit / 2);
+
+  float best_distance = 0;
+  vincenty(job->ra, ii, job->rb, best_index, &best_distance, NULL);
+  for(unsigned jj = 0; jj < nb; jj += 4) {
+    f4 h = haversine(p, Half4::load(job->hb, jj));
+    if(!(h <= f4(limit_h)).any()) continue;
+
+    for(unsigned kk = 0; kk < 4 && jj + kk < nb; ++kk) {
+      if(h[kk] <= limit_h && jj + kk != best_index) {
+        float d;
+        vincenty(job->ra, ii, job->rb, jj + kk, &d, NULL);
+        if(d < best_distance) {
+          best_distance = d;
+          best_index = jj + kk;
+        }
+      }
+    }
+  }
+
+  job->index[ii] = best_index;
+  if(job->distance) job->distance[ii] = best_distance;
+}
+
+static void item_job(void* ctx, unsigned index) {
+  const GeodesicJob* job = (const GeodesicJob*)ctx;
+  unsigned start = index * job->per_item;
+
+  if(job->kind == JOB_PAIRS) {
+    run_pairs(job, start, std::min(start + job->per_item, job->na));
+    return;
+  }
+
+  unsigned end = std::min(start + job->per_item, job->na);
+  for(unsigned ii = start; ii < end; ++ii) {
+    if(job->kind == JOB_ALL_PAIRS) {
+      run_row(job, ii);
+    } else {
+      run_nearest(job, ii);
+    }
+  }
+}
+
+static void run(GeodesicJob* job, const GeodeticArray& a, const GeodeticArray& b,
+                ThreadPool* pool) {
+  if(job->na == 0 || job->nb == 0) return;
+  job->a = &a;
+  job->b = &b;
+
+  if(job->method == GEODESIC_VINCENTY) {
+    reduced(a, &job->ra);
+    reduced(b, &job->rb);
+  }
+
+  // nearest uses haversine to narrow the search either way. single
+  // pairs don't reuse their angles so they skip the tables.
+  if((job->method == GEODESIC_HAVERSINE && job->kind != JOB_PAIRS) ||
+     job->kind == JOB_NEAREST) {
+    half_angles(a, &job->ha);
+    half_angles(b, &job->hb);
+  }
+
+  // pairs are split in multiples of four for the vector kernels
+  double work;
+  if(job->kind == JOB_PAIRS) {
+    job->per_item = chunk_size;
+    work = job->na;
+  } else {
+    job->per_item = std::max(1u, chunk_size / job->nb);
+    work = double(job->na) * job->nb;
+  }
+
+  unsigned items = (job->na + job->per_item - 1) / job->per_item;
+  if(pool && pool->size() > 1 && work >= point_batch_threshold) {
+    pool->parallel_for(items, item_job, job);
+  } else {
+    for(unsigned ii = 0; ii < items; ++ii) item_job(job, ii);
+  }
+}
+
+static void resize(std::vector<float>* v, size_t n, float** data) {
+  *data = NULL;
+  if(v) {
+    v->resize(n);
+    if(n) *data = &(*v)[0];
+  }
+}
+
+void geodesic_pairs(GeodesicMethod method, const GeodeticArray& a, const GeodeticArray& b,
+                    std::vector<float>* distance, std::vector<float>* bearing,
+                    ThreadPool* pool) {
+  GeodesicJob job;
+  job.kind = JOB_PAIRS;
+  job.method = method;
+  job.na = job.nb = std::min(a.size(), b.size());
+  job.index = NULL;
+  resize(distance, job.na, &job.distance);
+  resize(bearing, job.na, &job.bearing);
+  run(&job, a, b, pool);
+}
+
+void geodesic_all_pairs(GeodesicMethod method, const GeodeticArray& a, const GeodeticArray& b,
+                        std::vector<float>* distance, std::vector<float>* bearing,
+                        ThreadPool* pool) {
+  GeodesicJob job;
+  job.kind = JOB_ALL_PAIRS;
+  job.method = method;
+  job.na = a.size();
+  job.nb = b.size();
+  job.index = NULL;
+  resize(distance, (size_t)job.na * job.nb, &job.distance);
+  resize(bearing, (size_t)job.na * job.nb, &job.bearing);
+  run(&job, a, b, pool);
+}
+
+void geodesic_nearest(GeodesicMethod method, const GeodeticArray& a, const GeodeticArray& b,
+                      std::vector<unsigned>* index, std::vector<float>* distance,
+                      ThreadPool* pool) {
+  GeodesicJob job;
+  job.kind = JOB_NEAREST;
+  job.method = method;
+  job.na = a.size();
+  job.nb = b.size();
+  job.bearing = NULL;
+  index->resize(job.na);
+  job.index = job.na ? &(*index)[0] : NULL;
+  resize(distance, job.na, &job.distance);
+  run(&job, a, b, pool);
+}
@@ -0,0 +1,42 @@
+#ifndef GEODESIC_H
+#define GEODESIC_H
+
+#include "geodetic.h"
+
+// distances and bearings over the surface of the ellipsoid fromLatLon
+// builds. that's the unit sphere stretched to a polar radius of
+// (1 - E^2) Rn, so its lat is what geodesy calls the reduced latitude,
+// which is what Vincenty's method works in anyway. heights are ignored.
+// distances come out in the same units as Point, bearings are the
+// initial azimuth in radians clockwise from north, in (-pi, pi].
+typedef enum {
+  // great circles on a sphere of the ellipsoid's mean radius, in single
+  // precision four at a time. off by up to about half a percent.
+  GEODESIC_HAVERSINE,
+
+  // Vincenty's inverse method on the ellipsoid in double precision, one
+  // pair at a time. good to well under a millimeter except for nearly
+  // antipodal pairs, where it may not converge. those get the last
+  // iterate clamped to within 0.7% of the truth, and a rough bearing.
+  GEODESIC_VINCENTY
+} GeodesicMethod;
+
+// distance[ii] and bearing[ii] from a[ii] to b[ii]. either output may
+// be NULL. with a pool, big batches are spread over its threads.
+void geodesic_pairs(GeodesicMethod method, const GeodeticArray& a, const GeodeticArray& b,
+                    std::vector<float>* distance, std::vector<float>* bearing,
+                    ThreadPool* pool = NULL);
+
+// every a against every b. row ii of the a.size() by b.size() results
+// starts at ii * b.size().
+void geodesic_all_pairs(GeodesicMethod method, const GeodeticArray& a, const GeodeticArray& b,
+                        std::vector<float>* distance, std::vector<float>* bearing,
+                        ThreadPool* pool = NULL);
+
+// for each a the index of the nearest b and the distance to it, which
+// may be NULL. b may not be empty.
+void geodesic_nearest(GeodesicMethod method, const GeodeticArray& a, const GeodeticArray& b,
+                      std::vector<unsigned>* index, std::vector<float>* distance,
+                      ThreadPool* pool = NULL);
+
+#endif
@@ -0,0 +1,147 @@
+#include "geodetic.h"
+#include "simd_math.h"
+
+#include <algorithm>
+
+// work items handed to the pool are this many points
+static const unsigned chunk_size = 16384;
+
+// a kernel converts four entries of three input arrays into four of
+// three output arrays
+typedef void (*GeodeticKernel)(const float* a, const float* b, const float* c,
+                               float* oa, float* ob, float* oc);
+
+struct GeodeticJob {
+  GeodeticKernel kernel;
+  unsigned n;
+  const float* in[3];
+  float* out[3];
+};
+
+static void to_ecef4(const float* lat, const float* lon, const float* h,
+                     float* x, float* y, float* z) {
+  f4 a(earth_rn);
+  f4 b((1 - earth_e*earth_e) * earth_rn);
+
+  f4 slat, clat, slon, clon;
+  f4_sincos(f4::load(lat), &slat, &clat);
+  f4_sincos(f4::load(lon), &slon, &clon);
+  f4 hh = f4::load(h);
+
+  f4 r = (a + hh) * clat;
+  (r * clon).store(x);
+  (r * slon).store(y);
+  ((b + hh) * slat).store(z);
+}
+
+static void to_geodetic4(const float* x, const float* y, const float* z,
+                         float* lat, float* lon, float* h) {
+  f4 a(earth_rn);
+  f4 b((1 - earth_e*earth_e) * earth_rn);
+  f4 k = a - b;
+
+  f4 px = f4::load(x), py = f4::load(y), pz = f4::load(z);
+  f4 p = f4::sqrt(px * px + py * py);
+
+  // start at the h = 0 answer, the direction (b p, a z). the center of
+  // the earth has no answer so it gets the equator.
+  f4 c = b * p;
+  f4 s = a * pz;
+  f4 len2 = c * c + s * s;
+  f4 ok = f4(0) < len2;
+  f4 inv = f4(1) / f4::sqrt(f4::select(ok, len2, f4(1)));
+  c = f4::select(ok, c * inv, f4(1));
+  s = f4::select(ok, s * inv, f4(0));
+
+  // that's within e^2 of the latitude and each step squares the error,
+  // so two steps reach single precision. each rotates (c, s) by the
+  // Newton step d, small enough that two terms of sin and cos do.
+  for(unsigned ii = 0; ii < 2; ++ii) {
+    f4 f = p * s - pz * c - k * s * c;
+    f4 df = p * c + pz * s - k * (c * c - s * s);
+    f4 d = f4::select((df < f4(0)) | (f4(0) < df), -f / df, f4(0));
+
+    f4 d2 = d * d;
+    f4 sd = d - d * d2 * f4(1.0f / 6);
+    f4 cd = f4(1) - d2 * f4(0.5f);
+    f4 nc = c * cd - s * sd;
+    f4 ns = s * cd + c * sd;
+    f4 n = f4(1) / f4::sqrt(nc * nc + ns * ns);
+    c = nc * n;
+    s = ns * n;
+  }
+
+  f4_atan2(s, c).store(lat);
+  f4_atan2(py, px).store(lon);
+  (p * c + pz * s - (a * c * c + b * s * s)).store(h);
+}
+
+static void run_chunk(const GeodeticJob* job, unsigned start, unsigned count) {
+  const float* const* in = job->in;
+  float* const* out = job->out;
+
+  unsigned ii = start;
+  unsigned end = start + count;
+  for(; ii + 4 <= end; ii += 4) {
+    job->kernel(in[0] + ii, in[1] + ii, in[2] + ii, out[0] + ii, out[1] + ii, out[2] + ii);
+  }
+
+  // the last few go through padded copies
+  if(ii < end) {
+    float tin[3][4] = {{0}}, tout[3][4];
+    unsigned left = end - ii;
+    for(unsigned aa = 0; aa < 3; ++aa) {
+      std::copy(in[aa] + ii, in[aa] + end, tin[aa]);
+    }
+    job->kernel(tin[0], tin[1], tin[2], tout[0], tout[1], tout[2]);
+    for(unsigned aa = 0; aa < 3; ++aa) {
+      std::copy(tout[aa], tout[aa] + left, out[aa] + ii);
+    }
+  }
+}
+
+static void chunk_job(void* ctx, unsigned index) {
+  const GeodeticJob* job = (const GeodeticJob*)ctx;
+  unsigned start = index * chunk_size;
+  run_chunk(job, start, std::min(chunk_size, job->n - start));
+}
+
+static void run(GeodeticJob* job, ThreadPool* pool) {
+  if(pool && pool->size() > 1 && job->n >= point_batch_threshold) {
+    pool->parallel_for((job->n + chunk_size - 1) / chunk_size, chunk_job, job);
+  } else {
+    run_chunk(job, 0, job->n);
+  }
+}
+
+void geodetic_to_ecef(const GeodeticArray& in, PointArray* out, ThreadPool* pool) {
+  out->resize(in.size());
+
+  GeodeticJob job;
+  job.kernel = to_ecef4;
+  job.n = in.size();
+  if(job.n == 0) return;
+  job.in[0] = &in.lat[0];
+  job.in[1] = &in.lon[0];
+  job.in[2] = &in.h[0];
+  job.out[0] = &out->x[0];
+  job.out[1] = &out->y[0];
+  job.out[2] = &out->z[0];
+  run(&job, pool);
+}
+
+void ecef_to_geodetic(const PointArray& in, GeodeticArray* out, ThreadPool* pool) {
+  out->resize(in.size());
+
+  GeodeticJob job;
+  job.kernel = to_geodetic4;
+  job.n = in.size();
+  if(job.n == 0) return;
+  job.in[0] = &in.x[0];
+  job.in[1] = &in.y[0];
+  job.in[2] = &in.z[0];
+  job.out[0] = &out->lat[0];
+  job.out[1] = &out->lon[0];
+  job.out[2] = &out->h[0];
+  run(&job, pool);
+}
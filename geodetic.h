@@ -0,0 +1,40 @@
+#ifndef GEODETIC_H
+#define GEODETIC_H
+
+#include "point_array.h"
+
+#include <vector>
+
+// latitudes, longitudes (radians) and heights as separate arrays, the
+// geodetic counterpart of PointArray
+class GeodeticArray {
+public:
+  std::vector<float> lat, lon, h;
+
+  inline unsigned size() const {
+    return lat.size();
+  }
+
+  inline void resize(unsigned n) {
+    lat.resize(n);
+    lon.resize(n);
+    h.resize(n);
+  }
+
+  inline void push_back(float la, float lo, float hh) {
+    lat.push_back(la);
+    lon.push_back(lo);
+    h.push_back(hh);
+  }
+};
+
+// Point::fromLatLon over a whole array, four at a time in single
+// precision. with a pool, big batches are spread over its threads.
+void geodetic_to_ecef(const GeodeticArray& in, PointArray* out, ThreadPool* pool = NULL);
+
+// Point::toLatLon over a whole array. the same Newton iteration but
+// stepping the latitude's sine and cosine instead of the angle, so the
+// only trig is the final two atan2s.
+void ecef_to_geodetic(const PointArray& in, GeodeticArray* out, ThreadPool* pool = NULL);
+
+#endif
@@ -1,6 +1,96 @@
 #include "gl_headers.h"
 #include "utils.h"
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+GLCheckMode gl_check_mode = GL_CHECK_OFF;
+const char* gl_check_site = "no gl_check yet";
+
+static const char* mode_names[] = {"off", "callback", "sync"};
+
+bool gl_version_at_least(int want_major, int want_minor) {
+  // GLES prefixes its version with "OpenGL ES " so never matches
+  int major = 0, minor = 0;
+  const char* version = (const char*)glGetString(GL_VERSION);
+  if(!version || sscanf(version, "%d.%d", &major, &minor) != 2) return false;
+  return major > want_major || (major == want_major && minor >= want_minor);
+}
+
+bool gl_has_extension(const char* name) {
+#ifdef GL_NUM_EXTENSIONS
+  // core profiles only hand them out one at a time
+  if(gl_version_at_least(3, 0)) {
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint ii = 0; ii < count; ++ii) {
+      const char* ext = (const char*)glGetStringi(GL_EXTENSIONS, ii);
+      if(ext && strcmp(ext, name) == 0) return true;
+    }
+    return false;
+  }
+#endif
+
+  const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+  if(!extensions) return false;
+  size_t len = strlen(name);
+  for(const char* p = strstr(extensions, name); p; p = strstr(p + len, name)) {
+    if((p == extensions || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return true;
+  }
+  return false;
+}
+
+#ifdef GL_DEBUG_OUTPUT
+static void APIENTRY debug_callback(GLenum /*source*/, GLenum type, GLuint /*id*/,
+                                    GLenum /*severity*/, GLsizei /*length*/,
+                                    const GLchar* message, const void* /*user*/) {
+  if(type == GL_DEBUG_TYPE_ERROR) {
+    // asynchronous output can lag the call that caused it
+    LOGW("GL_ERROR: %s (%s %s)", message,
+         gl_check_mode == GL_CHECK_SYNC ? "at" : "near", gl_check_site);
+  } else {
+    LOGW("GL debug: %s", message);
+  }
+}
+#endif
+
+void gl_check_init() {
+  const char* forced = getenv("GL_CHECK");
+  bool have_debug = false;
+#ifdef GL_DEBUG_OUTPUT
+  have_debug = gl_version_at_least(4, 3) || gl_has_extension("GL_KHR_debug");
+#endif
+
+  GLCheckMode mode = have_debug ? GL_CHECK_CALLBACK : GL_CHECK_OFF;
+  if(forced && *forced) {
+    if(strcmp(forced, "off") == 0) {
+      mode = GL_CHECK_OFF;
+    } else if(strcmp(forced, "sync") == 0) {
+      mode = GL_CHECK_SYNC;
+    } else if(strcmp(forced, "callback") == 0 && have_debug) {
+      mode = GL_CHECK_CALLBACK;
+    } else {
+      LOGW("GL_CHECK=%s isn't available here, using %s", forced, mode_names[mode]);
+    }
+  }
+  gl_check_mode = mode;
+
+#ifdef GL_DEBUG_OUTPUT
+  if(have_debug && mode != GL_CHECK_OFF) {
+    // notifications are chatty and never point at a problem
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION,
+                          0, NULL, GL_FALSE);
+    glDebugMessageCallback((GLDEBUGPROC)debug_callback, NULL);
+    glEnable(GL_DEBUG_OUTPUT);
+    if(mode == GL_CHECK_SYNC) glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+  } else if(have_debug) {
+    glDisable(GL_DEBUG_OUTPUT);
+  }
+#endif
+
+  LOGI("gl errors: %s", mode_names[mode]);
+}
 
 void gl_check_(const char * msg) {
   GLenum error = glGetError();
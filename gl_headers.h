@@ -38,6 +38,16 @@
 
 #define glOrthof glOrtho
 
+#else
+#ifdef BUILD_EGL
+/* headless desktop GL through EGL, no window system required */
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
 #else
 #if defined(BUILD_RPI) || defined(BUILD_ANDROID)
 /* Rpi */
@@ -50,7 +60,8 @@
 #include "EGL/eglext.h"
 
 #else
-#error "Either BUILD_SDL or BUILD_RPI or BUILD_ANDROID must be defined"
+#error "One of BUILD_SDL, BUILD_EGL, BUILD_RPI or BUILD_ANDROID must be defined"
+#endif
 #endif
 #endif
 
@@ -60,16 +71,54 @@
 #define GL_WRITE_ONLY GL_WRITE_ONLY_OES
 #endif
 
+#if defined(BUILD_RPI) || defined(BUILD_ANDROID)
+/* program binaries are an OES extension on GLES2 */
+#define glGetProgramBinary glGetProgramBinaryOES
+#define glProgramBinary glProgramBinaryOES
+#define GL_NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#define GL_PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#endif
+
+// what the current context offers
+bool gl_version_at_least(int major, int minor);
+bool gl_has_extension(const char* name);
+
 // opengl error checking
 #define GL_CHECK_ERRORS
 
+// how gl_check finds errors, picked at runtime by gl_check_init from
+// GL_CHECK=off|callback|sync
+typedef enum {
+  // nothing is checked at all
+  GL_CHECK_OFF,
+
+  // the driver reports errors to a KHR_debug callback on its own time.
+  // gl_check just remembers where it is so the report can point at the
+  // call that most likely caused it. the default where KHR_debug exists.
+  GL_CHECK_CALLBACK,
+
+  // glGetError after every gl_check, which stalls on many drivers but
+  // names the exact call. debug output, if any, is made synchronous too.
+  GL_CHECK_SYNC
+} GLCheckMode;
+
+extern GLCheckMode gl_check_mode;
+extern const char* gl_check_site;
+
+// needs a current context
+void gl_check_init();
+
 void gl_check_(const char * msg);
 
 #define STRINGIZE(x) STRINGIZE2(x)
 #define STRINGIZE2(x) #x
 
 #ifdef GL_CHECK_ERRORS
-#define gl_check(command) command; gl_check_(__FILE__ ": " STRINGIZE(__LINE__) " " #command)
+#define gl_check(command) do {                                         \
+    gl_check_site = __FILE__ ": " STRINGIZE(__LINE__) " " #command;     \
+    command;                                                            \
+    if(gl_check_mode == GL_CHECK_SYNC) gl_check_(gl_check_site);        \
+  } while(0)
 #else
 #define gl_check(command) command
 #endif
@@ -0,0 +1,188 @@
+#include "gl_state.h"
+#include "utils.h"
+
+#include <string.h>
+
+// no object is ever given this name, so it never matches
+#define UNKNOWN_NAME ((GLuint)~0u)
+
+GLState gl_state;
+
+static const char* call_names[STATE_CALL_MAX] = {
+  "glUseProgram", "glActiveTexture", "glBindTexture", "glBindBuffer", "glBindBufferRange",
+  "glEnableVertexAttribArray", "glVertexAttribPointer", "glUniform"
+};
+
+static int texture_target_index(GLenum target) {
+  if(target == GL_TEXTURE_2D) return 0;
+  if(target == GL_TEXTURE_CUBE_MAP) return 1;
+  return -1;
+}
+
+GLState::GLState() {
+  invalidate();
+  reset_counters();
+}
+
+void GLState::invalidate() {
+  program = UNKNOWN_NAME;
+  active_unit = UNKNOWN_NAME;
+  for(unsigned ii = 0; ii < GL_STATE_MAX_UNITS; ++ii) {
+    textures[ii][0] = textures[ii][1] = UNKNOWN_NAME;
+  }
+  for(unsigned ii = 0; ii < GL_STATE_MAX_BUFFER_TARGETS; ++ii) {
+    buffer_targets[ii] = 0;
+    buffers[ii] = UNKNOWN_NAME;
+  }
+  for(unsigned ii = 0; ii < GL_STATE_MAX_ATTRIBUTES; ++ii) {
+    attributes[ii].enabled = -1;
+    attributes[ii].buffer = UNKNOWN_NAME;
+  }
+  for(unsigned ii = 0; ii < GL_STATE_MAX_UNIFORM_BINDINGS; ++ii) {
+    uniform_ranges[ii].buffer = UNKNOWN_NAME;
+  }
+}
+
+void GLState::use_program(GLuint new_program) {
+  bool issue = new_program != program;
+  count(STATE_CALL_USE_PROGRAM, issue);
+  if(!issue) return;
+
+  gl_check(glUseProgram(new_program));
+  program = new_program;
+}
+
+void GLState::active_texture(unsigned unit) {
+  bool issue = unit != active_unit;
+  count(STATE_CALL_ACTIVE_TEXTURE, issue);
+  if(!issue) return;
+
+  gl_check(glActiveTexture(GL_TEXTURE0 + unit));
+  active_unit = unit;
+}
+
+void GLState::bind_texture(GLenum target, GLuint texture) {
+  int index = texture_target_index(target);
+  GLuint* slot = NULL;
+  if(index >= 0 && active_unit < GL_STATE_MAX_UNITS) slot = &textures[active_unit][index];
+
+  bool issue = !slot || *slot != texture;
+  count(STATE_CALL_BIND_TEXTURE, issue);
+  if(!issue) return;
+
+  gl_check(glBindTexture(target, texture));
+  if(slot) *slot = texture;
+}
+
+// the shadow for target, claiming a free one the first time it's seen.
+// NULL once they're all taken, those targets just aren't tracked.
+GLuint* GLState::buffer_slot(GLenum target) {
+  for(unsigned ii = 0; ii < GL_STATE_MAX_BUFFER_TARGETS; ++ii) {
+    if(buffer_targets[ii] == target) return &buffers[ii];
+    if(buffer_targets[ii] == 0) {
+      buffer_targets[ii] = target;
+      return &buffers[ii];
+    }
+  }
+  return NULL;
+}
+
+void GLState::bind_buffer(GLenum target, GLuint buffer) {
+  GLuint* slot = buffer_slot(target);
+  bool issue = !slot || *slot != buffer;
+  count(STATE_CALL_BIND_BUFFER, issue);
+  if(!issue) return;
+
+  gl_check(glBindBuffer(target, buffer));
+  if(slot) *slot = buffer;
+}
+
+#ifdef GL_UNIFORM_BUFFER
+void GLState::bind_uniform_range(GLuint index, GLuint buffer, size_t offset, size_t size) {
+  Range* range = index < GL_STATE_MAX_UNIFORM_BINDINGS ? &uniform_ranges[index] : NULL;
+  bool issue = !range || range->buffer != buffer || range->offset != offset ||
+    range->size != size;
+  count(STATE_CALL_BIND_BUFFER_RANGE, issue);
+  if(!issue) return;
+
+  gl_check(glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, offset, size));
+  GLuint* slot = buffer_slot(GL_UNIFORM_BUFFER);
+  if(slot) *slot = buffer;
+  if(range) {
+    range->buffer = buffer;
+    range->offset = offset;
+    range->size = size;
+  }
+}
+#endif
+
+void GLState::enable_attribute(unsigned index) {
+  bool issue = index >= GL_STATE_MAX_ATTRIBUTES || attributes[index].enabled != 1;
+  count(STATE_CALL_ENABLE_ATTRIBUTE, issue);
+  if(!issue) return;
+
+  gl_check(glEnableVertexAttribArray(index));
+  if(index < GL_STATE_MAX_ATTRIBUTES) attributes[index].enabled = 1;
+}
+
+void GLState::attribute_pointer(unsigned index, GLint size, GLenum type, GLuint buffer,
+                                GLsizei stride, size_t offset) {
+  Attribute* attr = index < GL_STATE_MAX_ATTRIBUTES ? &attributes[index] : NULL;
+  bool issue = !attr || attr->buffer != buffer || attr->size != size ||
+    attr->type != type || attr->stride != stride || attr->offset != offset;
+  count(STATE_CALL_ATTRIBUTE_POINTER, issue);
+  if(!issue) return;
+
+  // the pointer captures whatever is bound to GL_ARRAY_BUFFER
+  bind_buffer(GL_ARRAY_BUFFER, buffer);
+  gl_check(glVertexAttribPointer(index, size, type, GL_FALSE, stride, (const void*)offset));
+  if(attr) {
+    attr->buffer = buffer;
+    attr->size = size;
+    attr->type = type;
+    attr->stride = stride;
+    attr->offset = offset;
+  }
+}
+
+void GLState::deleted_program(GLuint deleted) {
+  // a deleted program stays current until another is used, but its
+  // name may come back for a new one
+  if(program == deleted) program = UNKNOWN_NAME;
+}
+
+void GLState::deleted_texture(GLuint texture) {
+  for(unsigned ii = 0; ii < GL_STATE_MAX_UNITS; ++ii) {
+    for(unsigned tt = 0; tt < 2; ++tt) {
+      if(textures[ii][tt] == texture) textures[ii][tt] = 0;
+    }
+  }
+}
+
+void GLState::deleted_buffer(GLuint buffer) {
+  for(unsigned ii = 0; ii < GL_STATE_MAX_BUFFER_TARGETS; ++ii) {
+    if(buffers[ii] == buffer) buffers[ii] = 0;
+  }
+  for(unsigned ii = 0; ii < GL_STATE_MAX_ATTRIBUTES; ++ii) {
+    if(attributes[ii].buffer == buffer) attributes[ii].buffer = UNKNOWN_NAME;
+  }
+  for(unsigned ii = 0; ii < GL_STATE_MAX_UNIFORM_BINDINGS; ++ii) {
+    if(uniform_ranges[ii].buffer == buffer) uniform_ranges[ii].buffer = UNKNOWN_NAME;
+  }
+}
+
+void GLState::reset_counters() {
+  memset(issued_calls, 0, sizeof(issued_calls));
+  memset(skipped_calls, 0, sizeof(skipped_calls));
+}
+
+void GLState::report() const {
+  unsigned long total_issued = 0, total_skipped = 0;
+  for(unsigned ii = 0; ii < STATE_CALL_MAX; ++ii) {
+    LOGI("gl state: %-26s issued %8lu skipped %8lu", call_names[ii],
+         issued_calls[ii], skipped_calls[ii]);
+    total_issued += issued_calls[ii];
+    total_skipped += skipped_calls[ii];
+  }
+  LOGI("gl state: %-26s issued %8lu skipped %8lu", "total", total_issued, total_skipped);
+}
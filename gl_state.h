@@ -0,0 +1,110 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "gl_headers.h"
+
+#include <stddef.h>
+
+// a shadow of the GL binding state we touch every frame: the current
+// program, texture unit bindings, buffer bindings and the vertex
+// attribute arrays. calls that would set what's already set are
+// dropped, along with the glGetError that gl_check would follow them
+// with. everything that changes this state has to go through here (or
+// call invalidate after), or the shadow goes stale.
+//
+// uniform values live with their program, see Program::bind_uniform,
+// but are counted here too.
+
+typedef enum {
+  STATE_CALL_USE_PROGRAM,
+  STATE_CALL_ACTIVE_TEXTURE,
+  STATE_CALL_BIND_TEXTURE,
+  STATE_CALL_BIND_BUFFER,
+  STATE_CALL_BIND_BUFFER_RANGE,
+  STATE_CALL_ENABLE_ATTRIBUTE,
+  STATE_CALL_ATTRIBUTE_POINTER,
+  STATE_CALL_UNIFORM,
+  STATE_CALL_MAX
+} GLStateCall;
+
+#define GL_STATE_MAX_UNITS 16
+#define GL_STATE_MAX_ATTRIBUTES 16
+#define GL_STATE_MAX_BUFFER_TARGETS 8
+#define GL_STATE_MAX_UNIFORM_BINDINGS 8
+
+class GLState {
+ public:
+  GLState();
+
+  // forget everything, the next call of each kind is always issued
+  void invalidate();
+
+  void use_program(GLuint program);
+
+  // bind_texture binds on the active unit like glBindTexture does.
+  // only 2D and cube map targets are tracked.
+  void active_texture(unsigned unit);
+  void bind_texture(GLenum target, GLuint texture);
+
+  void bind_buffer(GLenum target, GLuint buffer);
+
+#ifdef GL_UNIFORM_BUFFER
+  // a range of buffer on uniform block binding point index. like GL
+  // this binds the whole buffer to GL_UNIFORM_BUFFER as well.
+  void bind_uniform_range(GLuint index, GLuint buffer, size_t offset, size_t size);
+#endif
+
+  // attribute_pointer binds buffer to GL_ARRAY_BUFFER only if the
+  // attribute doesn't already source it with the same layout
+  void enable_attribute(unsigned index);
+  void attribute_pointer(unsigned index, GLint size, GLenum type, GLuint buffer,
+                         GLsizei stride = 0, size_t offset = 0);
+
+  // deleting a name unbinds it behind our back
+  void deleted_program(GLuint program);
+  void deleted_texture(GLuint texture);
+  void deleted_buffer(GLuint buffer);
+
+  // issued and skipped calls since the last reset
+  void count(GLStateCall call, bool issued) {
+    if(issued) issued_calls[call]++;
+    else skipped_calls[call]++;
+  }
+  unsigned long issued(GLStateCall call) const { return issued_calls[call]; }
+  unsigned long skipped(GLStateCall call) const { return skipped_calls[call]; }
+  void reset_counters();
+  void report() const;
+
+ private:
+  struct Attribute {
+    int enabled; // -1 for unknown
+    GLuint buffer;
+    GLint size;
+    GLenum type;
+    GLsizei stride;
+    size_t offset;
+  };
+
+  GLuint program;
+  unsigned active_unit;
+  GLuint textures[GL_STATE_MAX_UNITS][2];
+  GLenum buffer_targets[GL_STATE_MAX_BUFFER_TARGETS];
+  GLuint buffers[GL_STATE_MAX_BUFFER_TARGETS];
+  Attribute attributes[GL_STATE_MAX_ATTRIBUTES];
+
+  struct Range {
+    GLuint buffer;
+    size_t offset;
+    size_t size;
+  };
+  Range uniform_ranges[GL_STATE_MAX_UNIFORM_BINDINGS];
+
+  unsigned long issued_calls[STATE_CALL_MAX];
+  unsigned long skipped_calls[STATE_CALL_MAX];
+
+  GLuint* buffer_slot(GLenum target);
+};
+
+extern GLState gl_state;
+
+#endif
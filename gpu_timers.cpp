@@ -0,0 +1,180 @@
+#include "gpu_timers.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+GPUTimers gpu_timers;
+
+static const char* pass_names[GPU_PASS_MAX] = {
+  "clear", "globe", "skybox", "readback"
+};
+
+struct PassStats {
+  unsigned frames;
+  double min, mean, p99, max;
+};
+
+static PassStats pass_stats(std::vector<double> samples) {
+  PassStats stats;
+  memset(&stats, 0, sizeof(stats));
+  stats.frames = samples.size();
+  if(samples.empty()) return stats;
+
+  std::sort(samples.begin(), samples.end());
+  double total = 0;
+  for(size_t ii = 0; ii < samples.size(); ++ii) total += samples[ii];
+
+  // nearest rank
+  size_t rank = (size_t)(0.99 * samples.size() + 0.999999);
+  stats.min = samples.front();
+  stats.mean = total / samples.size();
+  stats.p99 = samples[std::max(rank, (size_t)1) - 1];
+  stats.max = samples.back();
+  return stats;
+}
+
+GPUTimers::GPUTimers()
+  : json(false), current(0), dropped(0), warmed_up(false) {
+  sets[0].used = sets[1].used = 0;
+}
+
+void GPUTimers::init(bool per_process) {
+  const char* env = getenv("GPU_TIMERS");
+  if(!env || !*env) return;
+
+#ifdef GL_TIME_ELAPSED
+  if(gl_version_at_least(3, 3) || gl_has_extension("GL_ARB_timer_query")) {
+    // the format goes by the name asked for, before any pid suffix
+    size_t len = strlen(env);
+    json = len >= 5 && strcmp(env + len - 5, ".json") == 0;
+    path = per_process ? stdstring("%s.%d", env, (int)getpid()) : std::string(env);
+    LOGI("gpu timers: writing pass times to %s at exit", path.c_str());
+    return;
+  }
+#endif
+  LOGW("GPU_TIMERS is set but there are no timer queries here");
+}
+
+void GPUTimers::begin(GPUPass pass) {
+#ifdef GL_TIME_ELAPSED
+  if(!enabled()) return;
+
+  QuerySet* set = &sets[current];
+  if(set->used == set->queries.size()) {
+    GLuint query;
+    gl_check(glGenQueries(1, &query));
+    set->queries.push_back(query);
+    set->passes.push_back(pass);
+  }
+  set->passes[set->used] = pass;
+  gl_check(glBeginQuery(GL_TIME_ELAPSED, set->queries[set->used]));
+#endif
+}
+
+void GPUTimers::end() {
+#ifdef GL_TIME_ELAPSED
+  if(!enabled()) return;
+
+  gl_check(glEndQuery(GL_TIME_ELAPSED));
+  sets[current].used++;
+#endif
+}
+
+void GPUTimers::next_frame() {
+  if(!enabled()) return;
+
+  // the other set is from the frame before this one
+  current ^= 1;
+  collect(&sets[current], false);
+}
+
+void GPUTimers::collect(QuerySet* set, bool wait) {
+#ifdef GL_TIME_ELAPSED
+  if(!set->used) return;
+  unsigned used = set->used;
+  set->used = 0;
+
+  if(!wait) {
+    for(unsigned ii = 0; ii < used; ++ii) {
+      GLint available = GL_FALSE;
+      glGetQueryObjectiv(set->queries[ii], GL_QUERY_RESULT_AVAILABLE, &available);
+      if(!available) {
+        dropped++;
+        return;
+      }
+    }
+  }
+
+  double frame[GPU_PASS_MAX];
+  bool timed[GPU_PASS_MAX];
+  for(unsigned pass = 0; pass < GPU_PASS_MAX; ++pass) {
+    frame[pass] = 0;
+    timed[pass] = false;
+  }
+
+  for(unsigned ii = 0; ii < used; ++ii) {
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(set->queries[ii], GL_QUERY_RESULT, &ns);
+    frame[set->passes[ii]] += ns / 1e6;
+    timed[set->passes[ii]] = true;
+  }
+
+  // the first frame pays for lazily created GL state, and some drivers
+  // have no start time for a query that comes before any rendering
+  if(!warmed_up) {
+    warmed_up = true;
+    return;
+  }
+
+  for(unsigned pass = 0; pass < GPU_PASS_MAX; ++pass) {
+    if(timed[pass]) samples[pass].push_back(frame[pass]);
+  }
+#endif
+}
+
+void GPUTimers::report() {
+  if(!enabled()) return;
+
+  // the older frame first so samples stay in order
+  collect(&sets[current ^ 1], true);
+  collect(&sets[current], true);
+
+  PassStats stats[GPU_PASS_MAX];
+  for(unsigned pass = 0; pass < GPU_PASS_MAX; ++pass) {
+    stats[pass] = pass_stats(samples[pass]);
+    LOGI("gpu timers: %-10s frames %6u min %8.3f mean %8.3f p99 %8.3f max %8.3f ms",
+         pass_names[pass], stats[pass].frames, stats[pass].min, stats[pass].mean,
+         stats[pass].p99, stats[pass].max);
+  }
+  if(dropped) {
+    LOGI("gpu timers: %u frames dropped waiting on results", dropped);
+  }
+
+  FILE* f = fopen(path.c_str(), "w");
+  if(!f) {
+    LOGW("gpu timers: can't write %s", path.c_str());
+    return;
+  }
+
+  if(json) {
+    fprintf(f, "{\n  \"dropped_frames\": %u,\n  \"passes\": [\n", dropped);
+    for(unsigned pass = 0; pass < GPU_PASS_MAX; ++pass) {
+      fprintf(f, "    {\"pass\": \"%s\", \"frames\": %u, \"min_ms\": %.4f, \"mean_ms\": %.4f, "
+              "\"p99_ms\": %.4f, \"max_ms\": %.4f}%s\n", pass_names[pass], stats[pass].frames,
+              stats[pass].min, stats[pass].mean, stats[pass].p99, stats[pass].max,
+              pass + 1 < GPU_PASS_MAX ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+  } else {
+    fprintf(f, "pass,frames,min_ms,mean_ms,p99_ms,max_ms\n");
+    for(unsigned pass = 0; pass < GPU_PASS_MAX; ++pass) {
+      fprintf(f, "%s,%u,%.4f,%.4f,%.4f,%.4f\n", pass_names[pass], stats[pass].frames,
+              stats[pass].min, stats[pass].mean, stats[pass].p99, stats[pass].max);
+    }
+  }
+  fclose(f);
+}
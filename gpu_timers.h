@@ -0,0 +1,69 @@
+#ifndef GPU_TIMERS_H
+#define GPU_TIMERS_H
+
+#include "gl_headers.h"
+
+#include <string>
+#include <vector>
+
+// GPU time spent in each render pass, from GL_TIME_ELAPSED queries.
+// GPU_TIMERS names a file to write the per pass min/mean/p99 to at
+// exit, as JSON if it ends in .json and CSV otherwise. without it, or
+// without timer queries, begin and end do nothing.
+//
+// queries alternate between two sets a frame apart. a set is only read
+// back when it's about to be reused, by which time the GPU has almost
+// always finished with it, and a frame whose results still aren't in
+// is dropped rather than waited on. the first frame isn't counted.
+
+typedef enum {
+  GPU_PASS_CLEAR,
+  GPU_PASS_GLOBE,
+  GPU_PASS_SKYBOX,
+  GPU_PASS_READBACK,
+  GPU_PASS_MAX
+} GPUPass;
+
+class GPUTimers {
+ public:
+  GPUTimers();
+
+  // reads GPU_TIMERS, with a context current. with per_process the pid
+  // is appended to the file name, as trace_init does.
+  void init(bool per_process = false);
+
+  bool enabled() const { return !path.empty(); }
+
+  // passes can't nest, but one can be timed several times a frame (once
+  // per tile) and the times are added up
+  void begin(GPUPass pass);
+  void end();
+
+  // call once the frame's passes have all been issued
+  void next_frame();
+
+  // waits for the outstanding queries, logs the summary and writes it
+  // out
+  void report();
+
+ private:
+  struct QuerySet {
+    std::vector<GLuint> queries;
+    std::vector<GPUPass> passes;
+    unsigned used;
+  };
+
+  std::string path;
+  bool json;
+  QuerySet sets[2];
+  unsigned current;
+  unsigned dropped;
+  bool warmed_up;
+  std::vector<double> samples[GPU_PASS_MAX]; // ms per frame
+
+  void collect(QuerySet* set, bool wait);
+};
+
+extern GPUTimers gpu_timers;
+
+#endif
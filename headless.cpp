@@ -0,0 +1,114 @@
+#include "gl_headers.h"
+#include "headless.h"
+#include "utils.h"
+
+#include <string.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+static EGLSurface surface = EGL_NO_SURFACE;
+
+static bool has_extension(const char* extensions, const char* name) {
+  if(!extensions) return false;
+
+  size_t len = strlen(name);
+  const char* start = extensions;
+  while((start = strstr(start, name))) {
+    if((start == extensions || start[-1] == ' ') &&
+       (start[len] == ' ' || start[len] == '\0')) {
+      return true;
+    }
+    start += len;
+  }
+  return false;
+}
+
+static EGLDisplay open_display() {
+  // prefer mesa's surfaceless platform: it needs neither X nor a DRM
+  // device and falls through to llvmpipe when there is no GPU
+  const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  if(has_extension(client, "EGL_MESA_platform_surfaceless")) {
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(get_platform_display) {
+      EGLDisplay d = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA,
+                                          EGL_DEFAULT_DISPLAY, NULL);
+      if(d != EGL_NO_DISPLAY) return d;
+    }
+  }
+
+  return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+void headless_init() {
+  display = open_display();
+  if(display == EGL_NO_DISPLAY) {
+    fail_exit("unable to open an EGL display");
+  }
+
+  EGLint major, minor;
+  if(!eglInitialize(display, &major, &minor)) {
+    fail_exit("eglInitialize failed: 0x%x", eglGetError());
+  }
+
+  if(!eglBindAPI(EGL_OPENGL_API)) {
+    fail_exit("EGL display does not support desktop GL: 0x%x", eglGetError());
+  }
+
+  const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_NONE
+  };
+
+  EGLConfig config = NULL;
+  EGLint nconfigs = 0;
+  eglChooseConfig(display, config_attribs, &config, 1, &nconfigs);
+
+  const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+  bool surfaceless = has_extension(extensions, "EGL_KHR_surfaceless_context");
+
+  if(nconfigs == 0) {
+    if(!surfaceless || !has_extension(extensions, "EGL_KHR_no_config_context")) {
+      fail_exit("no usable EGL config");
+    }
+    config = NULL; // EGL_NO_CONFIG_KHR
+  }
+
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+  if(context == EGL_NO_CONTEXT) {
+    fail_exit("eglCreateContext failed: 0x%x", eglGetError());
+  }
+
+  if(!surfaceless) {
+    // we never draw to it but some drivers insist on a surface
+    const EGLint pbuffer_attribs[] = {
+      EGL_WIDTH, 1,
+      EGL_HEIGHT, 1,
+      EGL_NONE
+    };
+    surface = eglCreatePbufferSurface(display, config, pbuffer_attribs);
+    if(surface == EGL_NO_SURFACE) {
+      fail_exit("eglCreatePbufferSurface failed: 0x%x", eglGetError());
+    }
+  }
+
+  if(!eglMakeCurrent(display, surface, surface, context)) {
+    fail_exit("eglMakeCurrent failed: 0x%x", eglGetError());
+  }
+
+  LOGI("headless EGL %d.%d: %s", major, minor, glGetString(GL_RENDERER));
+}
+
+void headless_shutdown() {
+  if(display == EGL_NO_DISPLAY) return;
+
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if(surface != EGL_NO_SURFACE) eglDestroySurface(display, surface);
+  if(context != EGL_NO_CONTEXT) eglDestroyContext(display, context);
+  eglTerminate(display);
+
+  display = EGL_NO_DISPLAY;
+  context = EGL_NO_CONTEXT;
+  surface = EGL_NO_SURFACE;
+}
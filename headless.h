@@ -0,0 +1,9 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// offscreen GL context with no window system behind it. there is no
+// default framebuffer so all rendering has to go into an FBO.
+void headless_init();
+void headless_shutdown();
+
+#endif
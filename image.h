@@ -3,6 +3,8 @@
 
 #include "stb_image.h"
 #include "utils.h"
+#include "gl_state.h"
+#include "trace.h"
 
 #include <stdlib.h>
 #include <algorithm>
@@ -29,23 +31,32 @@ public:
   }
 
   inline static Image* from_file(const char* fname) {
+    TRACE_ZONE("decode image");
     Image* im = new Image(0, 0, 0);
     im->data = stbi_load(fname, &im->w, &im->h, &im->ch, 0);
     if(!im->data) fail_exit("failed to load %s", fname);
     return im;
   }
 
-  inline void to_ppm_file(FILE* f) {
+  inline static void ppm_header(FILE* f, unsigned w, unsigned h) {
     fprintf(f, "P6\n");
     fprintf(f, "%d %d 255\n", w, h);
+  }
 
+  // write our rows, bottom row first, as the next part of a ppm body
+  inline void ppm_rows(FILE* f, unsigned nrows) {
     if(ch != 3) fail_exit("cannot write a texture that doesn't have 3 channels");
 
-    for(int ii = (h-1); ii >= 0; --ii) {
+    for(int ii = (nrows-1); ii >= 0; --ii) {
       fwrite(data + (ii * w * ch), (w * ch), 1, f);
     }
   }
 
+  inline void to_ppm_file(FILE* f) {
+    ppm_header(f, w, h);
+    ppm_rows(f, h);
+  }
+
   inline void to_ppm(const char* fname) {
     FILE* f = fopen(fname, "w");
     if(!f) fail_exit("couldn't write to %s\n", fname);
@@ -84,10 +95,12 @@ public:
   }
 
   inline ~Texture() {
+    gl_state.deleted_texture(texture);
     glDeleteTextures(1, &texture);
   }
 
   static inline Texture* from_file(const char* fname) {
+    TRACE_ZONE("load texture");
     Image* im = Image::from_file(fname);
     Texture* tex = Texture::from_image(im);
     delete im;
@@ -108,15 +121,15 @@ public:
   }
 
   inline void bind(unsigned unit) {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_2D, texture);
+    gl_state.active_texture(unit);
+    gl_state.bind_texture(GL_TEXTURE_2D, texture);
     tunit = unit;
     bound = true;
   }
 
   inline void unbind() {
-    glActiveTexture(GL_TEXTURE0 + tunit);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    gl_state.active_texture(tunit);
+    gl_state.bind_texture(GL_TEXTURE_2D, 0);
     bound = false;
   }
 
@@ -195,7 +208,7 @@ public:
                  unsigned char* posz, unsigned char* negz) {
 
     gl_check(glGenTextures(1, &texture));
-    gl_check(glBindTexture(GL_TEXTURE_CUBE_MAP, texture));
+    gl_state.bind_texture(GL_TEXTURE_CUBE_MAP, texture);
     gl_check(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
     gl_check(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
     gl_check(glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE));
@@ -209,10 +222,11 @@ public:
     gl_check(glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_Z, 0, GL_RGB, w, h, 0, type, GL_UNSIGNED_BYTE, posz));
     gl_check(glTexImage2D(GL_TEXTURE_CUBE_MAP_NEGATIVE_Z, 0, GL_RGB, w, h, 0, type, GL_UNSIGNED_BYTE, negz));
 
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    gl_state.bind_texture(GL_TEXTURE_CUBE_MAP, 0);
   }
 
   inline ~CubeMap() {
+    gl_state.deleted_texture(texture);
     glDeleteTextures(1, &texture);
   }
 
@@ -247,15 +261,15 @@ public:
   }
 
   inline void bind(unsigned unit) {
-    glActiveTexture(GL_TEXTURE0 + unit);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
+    gl_state.active_texture(unit);
+    gl_state.bind_texture(GL_TEXTURE_CUBE_MAP, texture);
     tunit = unit;
     bound = true;
   }
 
   inline void unbind() {
-    glActiveTexture(GL_TEXTURE0 + tunit);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    gl_state.active_texture(tunit);
+    gl_state.bind_texture(GL_TEXTURE_CUBE_MAP, 0);
     bound = false;
   }
 };
@@ -0,0 +1,52 @@
+#include "ads_lighting.glsl"
+#include "uniform_blocks.glsl"
+
+// the ellipsoid's radii along the globe's axes
+uniform vec3 radii;
+
+varying vec3 vray;
+
+const float pi = 3.14159265358979;
+
+void main() {
+  // cast in globe space where the ellipsoid is axis aligned. mv is
+  // rigid so its inverse is the transposed rotation.
+  mat3 to_globe = transpose(mat3(mv));
+  vec3 center = vec3(mv * vec4(0, 0, 0, 1));
+  vec3 eye = to_globe * -center;
+  vec3 dir = to_globe * vray;
+
+  // scaled by the radii the ellipsoid is the unit sphere
+  vec3 o = eye / radii;
+  vec3 d = dir / radii;
+  float a = dot(d, d);
+  float b = dot(o, d);
+  float c = dot(o, o) - 1.0;
+  float disc = b * b - a * c;
+  if(disc < 0.0) discard;
+
+  float t = (-b - sqrt(disc)) / a;
+  if(t <= 0.0) discard;
+  vec3 hit = eye + dir * t;
+
+  // depth of the hit, not of the quad
+  vec4 clip = perspective * vec4(vray * t, 1);
+  gl_FragDepth = 0.5 * (clip.z / clip.w) + 0.5;
+
+  // invert Point::fromLatLon for the mesh's texture coordinates
+  float lat = asin(clamp(hit.z / radii.z, -1.0, 1.0));
+  float lon = atan(hit.y, hit.x);
+  vec2 tcoord = vec2((lon + pi) / (2.0 * pi), 0.5 - lat / pi);
+
+  // the same tangent frame ads.vert gets from the mesh: the normal is
+  // the position and the tangent is +z cross the unit normal
+  vec3 normal = hit;
+  vec3 tangent = cross(vec3(0, 0, 1), normalize(hit));
+  vec3 bitangent = cross(normal, tangent);
+  mat3 g2t = transpose(mat3(tangent, bitangent, normal));
+
+  vec3 eyeDir = g2t * normalize(eye - hit);
+  vec3 lightDir = g2t * normalize(to_globe * (light - center) - hit);
+
+  gl_FragColor = ads_lighting(tcoord, eyeDir, lightDir);
+}
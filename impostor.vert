@@ -0,0 +1,20 @@
+attribute vec3 vertex;
+
+#include "uniform_blocks.glsl"
+
+// camera space point on the quad
+varying vec3 vray;
+
+void main() {
+  // a quad facing the eye through the globe's center, just big enough
+  // to cover the silhouette of the unit sphere the globe fits inside
+  vec3 center = vec3(mv * vec4(0, 0, 0, 1));
+  float dist = length(center);
+  vec3 forward = center / dist;
+  vec3 side = normalize(cross(forward, abs(forward.y) < 0.99 ? vec3(0,1,0) : vec3(1,0,0)));
+  vec3 up = cross(side, forward);
+  float extent = dist / sqrt(max(dist * dist - 1.0, 1e-6));
+
+  vray = center + (side * vertex.x + up * vertex.y) * extent;
+  gl_Position = perspective * vec4(vray, 1);
+}
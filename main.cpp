@@ -8,56 +8,102 @@
 #include "image.h"
 #include "time.h"
 #include "camera.h"
+#include "workers.h"
+#include "frame_sink.h"
+#include "software.h"
+#include "raycast.h"
+#include "uniform_blocks.h"
+#include "gpu_timers.h"
+#include "trace.h"
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <SDL/SDL.h>
+#include <string.h>
 #include <math.h>
+#include <getopt.h>
+
+#ifdef BUILD_SDL
+#include <SDL/SDL.h>
+#else
+#include "headless.h"
+#endif
 
 #include <vector>
+#include <algorithm>
 
 unsigned screen_width = 1280;
 unsigned screen_height = 800;
 
-Program* ads_program_loader() {
-  Program *program = Program::create("ads.vert",
-                                     "ads.frag",
-                                     BINDING_ATTRIBUTES,
-                                     ATTRIBUTE_VERTEX, "vertex",
-                                     ATTRIBUTE_NORMAL0, "normal",
-                                     ATTRIBUTE_TEXCOORD0, "tcoord0",
-                                     ATTRIBUTE_TANGENT0, "tangent",
-
-                                     BINDING_UNIFORMS,
-                                     UNIFORM_TEX0, "colors",
-                                     UNIFORM_TEX1, "norm_spec",
-                                     UNIFORM_TEX2, "night_lights",
-                                     UNIFORM_MV, "mv",
-                                     UNIFORM_LIGHT0_POSITION, "light",
-                                     UNIFORM_PERSPECTIVE, "perspective",
+// output frames can be far larger than a single framebuffer. they're
+// rendered in tiles of at most tile_size on a side.
+unsigned output_width = 1280;
+unsigned output_height = 800;
+unsigned tile_size = 4096;
+
+// the optional terms of ads_lighting.glsl. the globe programs are
+// built once per combination in use, with the rest compiled out.
+typedef enum {
+  ADS_NIGHT_LIGHTS = 1 << 0,
+  ADS_SPECULAR = 1 << 1,
+  ADS_ALL = ADS_NIGHT_LIGHTS | ADS_SPECULAR
+} AdsFeatures;
+
+std::string ads_defines(unsigned features) {
+  std::string defines;
+  if(features & ADS_NIGHT_LIGHTS) defines += " NIGHT_LIGHTS";
+  if(features & ADS_SPECULAR) defines += " SPECULAR";
+  return defines.empty() ? defines : defines.substr(1);
+}
 
-                                     BINDING_DONE);
+Program* ads_program_loader(unsigned features) {
+  Program *program = Program::create_variant(ads_defines(features).c_str(),
+                                             "ads.vert",
+                                             "ads.frag",
+                                             BINDING_ATTRIBUTES,
+                                             ATTRIBUTE_VERTEX, "vertex",
+                                             ATTRIBUTE_NORMAL0, "normal",
+                                             ATTRIBUTE_TEXCOORD0, "tcoord0",
+                                             ATTRIBUTE_TANGENT0, "tangent",
+
+                                             BINDING_BLOCKS,
+                                             BLOCK_FRAME, "Frame",
+                                             BLOCK_OBJECT, "Object",
+
+                                             BINDING_UNIFORMS,
+                                             UNIFORM_TEX0, "colors",
+                                             UNIFORM_TEX1, "norm_spec",
+                                             UNIFORM_TEX2,
+                                             (features & ADS_NIGHT_LIGHTS) ? "night_lights" : NULL,
+                                             UNIFORM_MV, "mv",
+                                             UNIFORM_LIGHT0_POSITION, "light",
+                                             UNIFORM_PERSPECTIVE, "perspective",
+
+                                             BINDING_DONE);
 
   return program;
 }
 
-Program* skybox_program_loader() {
+Program* skybox_program_loader(unsigned /*variant*/) {
   Program* program = Program::create("skybox.vert",
                                      "skybox.frag",
                                      BINDING_ATTRIBUTES,
                                      ATTRIBUTE_VERTEX, "vertex",
 
+                                     BINDING_BLOCKS,
+                                     BLOCK_FRAME, "Frame",
+                                     BLOCK_OBJECT, "Object",
+
                                      BINDING_UNIFORMS,
                                      UNIFORM_TEX0, "colors",
                                      UNIFORM_MV, "mv",
-                                     UNIFORM_PERSPECTIVE, "perspective_inv",
+                                     UNIFORM_PERSPECTIVE_INV, "perspective_inv",
 
                                      BINDING_DONE);
 
   return program;
 }
 
-Program* simple_program_loader() {
+Program* simple_program_loader(unsigned /*variant*/) {
   Program* program = Program::create("simple.vert",
                                      "simple.frag",
                                      BINDING_ATTRIBUTES,
@@ -65,6 +111,10 @@ Program* simple_program_loader() {
                                      ATTRIBUTE_TEXCOORD0, "tcoord0",
                                      ATTRIBUTE_NORMAL0, "normal",
 
+                                     BINDING_BLOCKS,
+                                     BLOCK_FRAME, "Frame",
+                                     BLOCK_OBJECT, "Object",
+
                                      BINDING_UNIFORMS,
                                      UNIFORM_MV, "mv",
                                      UNIFORM_PERSPECTIVE, "perspective",
@@ -75,65 +125,242 @@ Program* simple_program_loader() {
   return program;
 }
 
+Program* impostor_program_loader(unsigned features) {
+  Program* program = Program::create_variant(ads_defines(features).c_str(),
+                                             "impostor.vert",
+                                             "impostor.frag",
+                                             BINDING_ATTRIBUTES,
+                                             ATTRIBUTE_VERTEX, "vertex",
+
+                                             BINDING_BLOCKS,
+                                             BLOCK_FRAME, "Frame",
+                                             BLOCK_OBJECT, "Object",
+
+                                             BINDING_UNIFORMS,
+                                             UNIFORM_TEX0, "colors",
+                                             UNIFORM_TEX1, "norm_spec",
+                                             UNIFORM_TEX2,
+                                             (features & ADS_NIGHT_LIGHTS) ? "night_lights" : NULL,
+                                             UNIFORM_MV, "mv",
+                                             UNIFORM_LIGHT0_POSITION, "light",
+                                             UNIFORM_PERSPECTIVE, "perspective",
+                                             UNIFORM_SCALE, "radii",
+
+                                             BINDING_DONE);
+
+  return program;
+}
 
 GLuint vbuffer, tbuffer, nbuffer, tanbuffer, qverts;
-Program *ads;
-Program *skybox;
-Program *simple;
+
+// ray cast the globe in a screen quad instead of drawing the mesh
+bool use_impostor = false;
+
+// the lighting the scene asks for, each frame picks its globe program
+// variant from these
+unsigned scene_features = ADS_ALL;
+
+// seconds into the sequence, for the Frame block
+double scene_time = 0;
+
+UniformBlocks* uniform_blocks;
 
 Texture* colors;
 Texture* norm_spec;
 Texture* night_lights;
 CubeMap* stars;
 
+const double rotation_rate = 2 * M_PI * 0.05; // 1/20 rev per second
+const double output_frame_rate = 60.0;
+
 float angle;
 unsigned points_size;
 Camera camera(d2r(60), float(screen_width) / float(screen_height),
               0.1, 1000.0);
-Matrix perspective(camera.getPerspectiveTransform());
 
-void render_frame(const TimeLength& dt) {
-  Matrix pole_up = Matrix::rotation(-M_PI/2, Vector(1,0,0));
-  Matrix o2w = Matrix::rotation(angle, Vector(0,1,0)) * pole_up;
-  Matrix w2c = camera.getWorldToCamera();
-  Matrix m = w2c * o2w;
+// scene state for an output frame depends only on the frame index so
+// any range of a sequence can be rendered on its own
+void set_frame_state(unsigned frame) {
+  double t = frame / output_frame_rate;
+  angle = fmod(t * rotation_rate, 2 * M_PI);
+  scene_time = t;
+
+  camera.setPosition(Vector(0, 0, 10));
+  camera.setOrientation(Vector(0, 0, -1), Vector(0, 1, 0));
+}
 
-  angle += dt.seconds() * (2 * M_PI * 0.05); // 1/20 rev per second
+// the globe's modelview, the light in camera space and the skybox
+// rotation for the current angle and camera
+void frame_transforms(Matrix* mv, Point* light, Matrix* sky_mv) {
+  Rigid<float> pole_up = Rigid<float>::rotation(-M_PI/2, Vector(1,0,0));
+  const Rigid<float>& w2c = camera.getView();
+  *mv = (w2c * Rigid<float>::rotation(angle, Vector(0,1,0)) * pole_up).matrix();
+  *light = w2c * Point(100, 0, 100);
+  *sky_mv = Rigid<float>(w2c.r, Vec3<float>()).inverse().matrix();
+}
 
+void render_frame() {
+  TRACE_ZONE("render_frame");
+  Matrix m, sky_mv;
+  Point light;
+  frame_transforms(&m, &light, &sky_mv);
+
+  // everything every draw shares goes up once
+  FrameBlock frame;
+  memcpy(frame.view, camera.getViewMatrix().data, sizeof(frame.view));
+  memcpy(frame.perspective, camera.getProjection().data, sizeof(frame.perspective));
+  memcpy(frame.perspective_inv, camera.getProjectionInverse().data,
+         sizeof(frame.perspective_inv));
+  frame.light[0] = light.x;
+  frame.light[1] = light.y;
+  frame.light[2] = light.z;
+  frame.time = scene_time;
+  uniform_blocks->set_frame(frame);
+
+  ObjectBlock globe;
+  memcpy(globe.mv, m.data, sizeof(globe.mv));
+
+  gpu_timers.begin(GPU_PASS_CLEAR);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  gpu_timers.end();
+
+  // looking away from the globe leaves only the sky to draw
+  bool globe_visible = camera.sphereVisible(Point(0, 0, 0), 1);
+  if(globe_visible) gpu_timers.begin(GPU_PASS_GLOBE);
+
+  if(globe_visible && use_impostor) {
+    Program* impostor = get_program(impostor_program_loader, scene_features);
+    impostor->use();
+
+    // the full screen quad's corners double as the impostor's
+    impostor->bind_attribute_buffer(ATTRIBUTE_VERTEX, 3, qverts);
+
+    impostor->bind_uniform(colors, UNIFORM_TEX0);
+    impostor->bind_uniform(norm_spec, UNIFORM_TEX1);
+    if(scene_features & ADS_NIGHT_LIGHTS) impostor->bind_uniform(night_lights, UNIFORM_TEX2);
 
-  ads->use();
+    // the radii of the ellipsoid fromLatLon builds
+    Vector radii(Point::fromLatLon(0, 0).x,
+                 Point::fromLatLon(0, M_PI/2).y,
+                 Point::fromLatLon(M_PI/2, 0).z);
 
-  // attributes
-  ads->bind_attribute_buffer(ATTRIBUTE_VERTEX, 3, vbuffer);
-  ads->bind_attribute_buffer(ATTRIBUTE_NORMAL0, 3, nbuffer);
-  ads->bind_attribute_buffer(ATTRIBUTE_TEXCOORD0, 2, tbuffer);
-  ads->bind_attribute_buffer(ATTRIBUTE_TANGENT0, 3, tanbuffer);
+    uniform_blocks->set_object(impostor, globe);
+    impostor->bind_uniform(radii, UNIFORM_SCALE);
 
-  // textures
-  ads->bind_uniform(colors, UNIFORM_TEX0);
-  ads->bind_uniform(norm_spec, UNIFORM_TEX1);
-  ads->bind_uniform(night_lights, UNIFORM_TEX2);
+    gl_check(glDrawArrays(GL_TRIANGLES, 0, 6));
+  } else if(globe_visible) {
+    Program* ads = get_program(ads_program_loader, scene_features);
+    ads->use();
 
-  // light
-  Point light = w2c * Point(100, 0, 100);
-  ads->bind_uniform(light, UNIFORM_LIGHT0_POSITION);
-  ads->bind_uniform(m, UNIFORM_MV);
-  ads->bind_uniform(perspective, UNIFORM_PERSPECTIVE);
+    // attributes
+    ads->bind_attribute_buffer(ATTRIBUTE_VERTEX, 3, vbuffer);
+    ads->bind_attribute_buffer(ATTRIBUTE_NORMAL0, 3, nbuffer);
+    ads->bind_attribute_buffer(ATTRIBUTE_TEXCOORD0, 2, tbuffer);
+    ads->bind_attribute_buffer(ATTRIBUTE_TANGENT0, 3, tanbuffer);
 
-  gl_check(glDrawArrays(GL_TRIANGLES, 0, points_size));
+    // textures
+    ads->bind_uniform(colors, UNIFORM_TEX0);
+    ads->bind_uniform(norm_spec, UNIFORM_TEX1);
+    if(scene_features & ADS_NIGHT_LIGHTS) ads->bind_uniform(night_lights, UNIFORM_TEX2);
+
+    uniform_blocks->set_object(ads, globe);
+
+    gl_check(glDrawArrays(GL_TRIANGLES, 0, points_size));
+  }
+  if(globe_visible) gpu_timers.end();
 
   // render the skybox
+  gpu_timers.begin(GPU_PASS_SKYBOX);
+  Program* skybox = get_program(skybox_program_loader);
   skybox->use();
 
   skybox->bind_attribute_buffer(ATTRIBUTE_VERTEX, 3, qverts);
   skybox->bind_uniform(stars, UNIFORM_TEX0);
-  skybox->bind_uniform(camera.getWorldToCamera(true).invertspecial(), UNIFORM_MV);
-  skybox->bind_uniform(perspective.invert(), UNIFORM_PERSPECTIVE);
+
+  ObjectBlock sky;
+  memcpy(sky.mv, sky_mv.data, sizeof(sky.mv));
+  uniform_blocks->set_object(skybox, sky);
 
   gl_check(glDrawArrays(GL_TRIANGLES, 0, 6));
+  gpu_timers.end();
 
+#ifdef BUILD_SDL
   SDL_GL_SwapBuffers();
+#endif
+}
+
+// render the current frame in tiles no larger than the FBO and stream
+// it to the sink one strip of tiles at a time, so the whole image is
+// never in memory.
+void render_tiled(FBO* fbo, Image* strip, FrameSink* sink, unsigned frame) {
+  TRACE_ZONE("render_tiled");
+  unsigned width = output_width;
+  unsigned height = output_height;
+  unsigned tile_w = fbo->texture->w;
+  unsigned tile_h = fbo->texture->h;
+
+  sink->begin_frame(frame, width, height);
+
+  fbo->bind();
+  gl_check(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+  gl_check(glPixelStorei(GL_PACK_ROW_LENGTH, width));
+
+  // ppm rows run top to bottom so walk the strips down from the top
+  for(unsigned y0 = 0; y0 < height; y0 += tile_h) {
+    unsigned th = std::min(tile_h, height - y0);
+    double bottom = double(height - y0 - th) / height;
+    double top = double(height - y0) / height;
+
+    for(unsigned x0 = 0; x0 < width; x0 += tile_w) {
+      unsigned tw = std::min(tile_w, width - x0);
+      camera.setWindow(double(x0) / width, bottom, double(x0 + tw) / width, top);
+
+      glViewport(0, 0, tw, th);
+      render_frame();
+
+      // waits for the tile to finish drawing
+      TRACE_ZONE("readback");
+      gpu_timers.begin(GPU_PASS_READBACK);
+      gl_check(glReadPixels(0, 0, tw, th, GL_RGB, GL_UNSIGNED_BYTE,
+                            strip->data + x0 * strip->ch));
+      gpu_timers.end();
+    }
+
+    sink->write_rows(strip, th);
+  }
+
+  gl_check(glPixelStorei(GL_PACK_ROW_LENGTH, 0));
+  fbo->unbind();
+  camera.setWindow(0, 0, 1, 1);
+
+  sink->end_frame();
+}
+
+// the same strips as render_tiled but drawn on the CPU. strips can be
+// as tall as we like since there's no framebuffer limit to respect.
+void render_software(CpuRenderer* sw, Image* strip, FrameSink* sink, unsigned frame) {
+  TRACE_ZONE("render_software");
+  unsigned width = output_width;
+  unsigned height = output_height;
+  unsigned strip_h = strip->h;
+
+  Matrix m, sky_mv;
+  Point light;
+  frame_transforms(&m, &light, &sky_mv);
+
+  sink->begin_frame(frame, width, height);
+
+  for(unsigned y0 = 0; y0 < height; y0 += strip_h) {
+    unsigned th = std::min(strip_h, height - y0);
+    camera.setWindow(0, double(height - y0 - th) / height, 1, double(height - y0) / height);
+
+    sw->render(strip, th, m, camera.getProjection(), light, sky_mv,
+               camera.getProjectionInverse());
+    sink->write_rows(strip, th);
+  }
+  camera.setWindow(0, 0, 1, 1);
+
+  sink->end_frame();
 }
 
 float absclamp(float val, float maxabs) {
@@ -142,15 +369,9 @@ float absclamp(float val, float maxabs) {
   return val;
 }
 
-int main(int argc, char** argv) {
-  char* output_prefix = NULL;
-  int output_frames = 0;
-
-  if(argc == 3) {
-    output_prefix = argv[1];
-    output_frames = atoi(argv[2]);
-  }
-
+void init_gl(bool per_process) {
+  TRACE_ZONE("init_gl");
+#ifdef BUILD_SDL
   if(SDL_Init(SDL_INIT_VIDEO) < 0) {
     fail_exit("unable to init SDL: %s\n", SDL_GetError());
   }
@@ -165,12 +386,28 @@ int main(int argc, char** argv) {
   if(glewInit() != GLEW_OK) {
     fail_exit("failed to initialize GLEW");
   }
+#else
+  headless_init();
+#endif
+  gl_check_init();
+  gpu_timers.init(per_process);
+
+  // every program the first frame needs is submitted up front and
+  // compiles while the rest of startup goes on. the first frame only
+  // waits on whichever aren't done by then.
+  if(use_impostor) {
+    prepare_program(impostor_program_loader, scene_features);
+  } else {
+    prepare_program(ads_program_loader, scene_features);
+  }
+  prepare_program(skybox_program_loader);
+  prepare_program(simple_program_loader);
+  uniform_blocks = new UniformBlocks();
+  LOGI("uniform data in %s", uniform_blocks_supported() ? "uniform buffers" : "plain uniforms");
 
-  ads = get_program(ads_program_loader);
-  skybox = get_program(skybox_program_loader);
-  simple = get_program(simple_program_loader);
-
+#ifdef BUILD_SDL
   SDL_WM_SetCaption("Chuckle", NULL);
+#endif
 
   glEnable(GL_TEXTURE_2D);
   glEnable(GL_BLEND);
@@ -182,109 +419,277 @@ int main(int argc, char** argv) {
 
   glClearColor(0,0,0,0);
   glViewport(0, 0, screen_width, screen_height);
+#ifdef BUILD_SDL
+  // headless contexts have no default framebuffer to clear
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+#endif
 
   gl_check(glGenBuffers(1, &vbuffer));
   gl_check(glGenBuffers(1, &tbuffer));
   gl_check(glGenBuffers(1, &nbuffer));
   gl_check(glGenBuffers(1, &tanbuffer));
+}
 
-  unsigned lats = 90;
-  unsigned lons = 90;
-  double lat_step = M_PI / lats;
-  double lon_step = 2 * M_PI / lons;
-
-  Points points;
-  Points normals;
-  Points tangents;
-  TexCoords tcoords;
-
-  float alt = 0;
-  Vector axis(0,0,1);
-
-  for(unsigned ilat = 0; ilat < lats; ++ilat) {
-    float hlat = -M_PI/2 + lat_step * ilat;
-    float nlat = hlat + lat_step;
-
-    float rhlat = 1.0f - float(ilat) / float(lats);
-    float rnlat = 1.0f - float(ilat+1) / float(lats);
-
-    for(unsigned ilon = 0; ilon < lons; ++ilon) {
-      // generate a quad "here" to "next"
-      float hlon = -M_PI + lon_step * ilon;
-      float nlon = hlon + lon_step;
-
-      float rhlon = float(ilon) / float(lons);
-      float rnlon  = float(ilon+1) / float(lons);
-
-      points.push_back(Point::fromLatLon(hlat, hlon, alt));
-      tcoords.push_back(TexCoord(rhlon, rhlat));
-      Vector n1 = Point::fromLatLon(hlat, hlon, alt).norm();
-      normals.push_back(n1);
-      tangents.push_back(axis.cross(n1));
-
-      points.push_back(Point::fromLatLon(nlat, nlon, alt));
-      tcoords.push_back(TexCoord(rnlon, rnlat));
-      Vector n3 = Point::fromLatLon(nlat, nlon, alt).norm();
-      normals.push_back(n3);
-      tangents.push_back(axis.cross(n3));
-
-      points.push_back(Point::fromLatLon(nlat, hlon, alt));
-      tcoords.push_back(TexCoord(rhlon, rnlat));
-      Vector n2 = Point::fromLatLon(nlat, hlon, alt).norm();
-      normals.push_back(n2);
-      tangents.push_back(axis.cross(n2));
-
-      points.push_back(Point::fromLatLon(nlat, nlon, alt));
-      tcoords.push_back(TexCoord(rnlon, rnlat));
-      Vector n4 = Point::fromLatLon(nlat, nlon, alt).norm();
-      normals.push_back(n4);
-      tangents.push_back(axis.cross(n4));
-
-      points.push_back(Point::fromLatLon(hlat, hlon, alt));
-      tcoords.push_back(TexCoord(rhlon, rhlat));
-      Vector n6 = Point::fromLatLon(hlat, hlon, alt).norm();
-      normals.push_back(n6);
-      tangents.push_back(axis.cross(n6));
-
-      points.push_back(Point::fromLatLon(hlat, nlon, alt));
-      tcoords.push_back(TexCoord(rnlon, rhlat));
-      Vector n5 = Point::fromLatLon(hlat, nlon, alt).norm();
-      normals.push_back(n5);
-      tangents.push_back(axis.cross(n5));
-    }
-  }
-
+void upload_globe(const Points& points, const Points& normals,
+                  const Points& tangents, const TexCoords& tcoords) {
+  TRACE_ZONE("upload_globe");
   // bind all of our constant data
 
   // verts
-  gl_check(glBindBuffer(GL_ARRAY_BUFFER, vbuffer));
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, vbuffer);
   gl_check(glBufferData(GL_ARRAY_BUFFER, sizeof(Point) * points.size(),
                         (float*)&points[0], GL_DYNAMIC_DRAW));
   // normals
-  gl_check(glBindBuffer(GL_ARRAY_BUFFER, nbuffer));
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, nbuffer);
   gl_check(glBufferData(GL_ARRAY_BUFFER, sizeof(Point) * normals.size(),
                         (float*)&points[0], GL_DYNAMIC_DRAW));
   // texs
-  gl_check(glBindBuffer(GL_ARRAY_BUFFER, tbuffer));
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, tbuffer);
   gl_check(glBufferData(GL_ARRAY_BUFFER, sizeof(TexCoord) * tcoords.size(),
                         (float*)&tcoords[0], GL_DYNAMIC_DRAW));
   // tangents
-  gl_check(glBindBuffer(GL_ARRAY_BUFFER, tanbuffer));
+  gl_state.bind_buffer(GL_ARRAY_BUFFER, tanbuffer);
   gl_check(glBufferData(GL_ARRAY_BUFFER, sizeof(Point) * tangents.size(),
                         (float*)&tangents[0], GL_DYNAMIC_DRAW));
+}
 
-  points_size = points.size();
-
+// decoding is slow enough that programs finish in between
+void load_gl_textures() {
+  TRACE_ZONE("load_gl_textures");
   colors = Texture::from_file("world.png");
+  poll_programs();
   norm_spec = Texture::from_file("EarthNormSpec.png");
+  poll_programs();
   night_lights = Texture::from_file("earth_lights.png");
+  poll_programs();
   stars = CubeMap::from_files("purplenebula_left.jpg",
                               "purplenebula_right.jpg",
                               "purplenebula_top.jpg",
                               "purplenebula_top.jpg",
                               "purplenebula_front.jpg",
                               "purplenebula_back.jpg");
+  poll_programs();
+}
+
+void usage(const char* name) {
+  fail_exit("usage: %s [--start N] [--end N] [--workers N] [--size WxH] [--tile N]\n"
+            "          [--resume] [--skip-unchanged] [--change-threshold N]\n"
+            "          [--software] [--raycast] [--threads N] [--impostor]\n"
+            "          [--no-night-lights] [--no-specular] [--watch-shaders]\n"
+            "          <output_prefix|-> [frames]\n"
+            "  renders frames [start, end) where end defaults to frames", name);
+}
+
+unsigned parse_count(const char* arg, const char* name) {
+  char* endp;
+  long val = strtol(arg, &endp, 10);
+  if(*arg == '\0' || *endp != '\0' || val < 0) {
+    fail_exit("%s must be a non-negative integer, got '%s'", name, arg);
+  }
+  return (unsigned)val;
+}
+
+int main(int argc, char** argv) {
+  char* output_prefix = NULL;
+  unsigned start_frame = 0;
+  unsigned end_frame = 0;
+  unsigned nworkers = 1;
+  bool have_end = false;
+  bool resume = false;
+  bool skip_unchanged = false;
+  unsigned change_threshold = 0;
+  bool software = false;
+  bool raycast = false;
+  unsigned nthreads = 0;
+  bool watch_shaders = false;
+
+  static const struct option options[] = {
+    {"start", required_argument, NULL, 's'},
+    {"end", required_argument, NULL, 'e'},
+    {"workers", required_argument, NULL, 'j'},
+    {"size", required_argument, NULL, 'S'},
+    {"tile", required_argument, NULL, 't'},
+    {"resume", no_argument, NULL, 'r'},
+    {"skip-unchanged", no_argument, NULL, 'u'},
+    {"change-threshold", required_argument, NULL, 'c'},
+    {"software", no_argument, NULL, 'w'},
+    {"raycast", no_argument, NULL, 'R'},
+    {"impostor", no_argument, NULL, 'i'},
+    {"threads", required_argument, NULL, 'T'},
+    {"no-night-lights", no_argument, NULL, 'n'},
+    {"no-specular", no_argument, NULL, 'p'},
+    {"watch-shaders", no_argument, NULL, 'W'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int opt;
+  while((opt = getopt_long(argc, argv, "s:e:j:S:t:ruc:wRT:inpW", options, NULL)) != -1) {
+    switch(opt) {
+    case 's': start_frame = parse_count(optarg, "--start"); break;
+    case 'e': end_frame = parse_count(optarg, "--end"); have_end = true; break;
+    case 'j': nworkers = parse_count(optarg, "--workers"); break;
+    case 'S':
+      if(sscanf(optarg, "%ux%u", &output_width, &output_height) != 2 ||
+         output_width == 0 || output_height == 0) {
+        fail_exit("--size must look like 1280x800, got '%s'", optarg);
+      }
+      break;
+    case 't':
+      tile_size = parse_count(optarg, "--tile");
+      if(tile_size == 0) fail_exit("--tile must be positive");
+      break;
+    case 'r': resume = true; break;
+    case 'u': skip_unchanged = true; break;
+    case 'c':
+      change_threshold = parse_count(optarg, "--change-threshold");
+      skip_unchanged = true;
+      break;
+    case 'w': software = true; break;
+    case 'R': software = raycast = true; break;
+    case 'i': use_impostor = true; break;
+    case 'T': nthreads = parse_count(optarg, "--threads"); break;
+    case 'n': scene_features &= ~ADS_NIGHT_LIGHTS; break;
+    case 'p': scene_features &= ~ADS_SPECULAR; break;
+    case 'W': watch_shaders = true; break;
+    default: usage(argv[0]);
+    }
+  }
+
+  int npositional = argc - optind;
+  if(npositional > 2) usage(argv[0]);
+  if(npositional >= 1) output_prefix = argv[optind];
+  if(npositional == 2 && !have_end) {
+    end_frame = parse_count(argv[optind + 1], "frames");
+    have_end = true;
+  }
+
+  FrameSink* sink = NULL;
+  if(output_prefix) {
+    if(!have_end || end_frame <= start_frame) {
+      fail_exit("empty frame range [%u, %u)", start_frame, end_frame);
+    }
+
+    sink = new FrameSink(output_prefix);
+    if(skip_unchanged) sink->skip_unchanged(change_threshold);
+    if(resume) {
+      if(strcmp(output_prefix, "-") == 0) {
+        fail_exit("--resume needs an output prefix, not stdout");
+      }
+      sink->load_manifest();
+
+      // don't spin up GL or workers for a leading run of finished frames
+      while(start_frame < end_frame && sink->is_done(start_frame)) start_frame++;
+      if(start_frame == end_frame) {
+        LOGI("all frames are already complete");
+        delete sink;
+        return 0;
+      }
+    }
+
+    if(nworkers > 1) {
+      if(strcmp(output_prefix, "-") == 0) {
+        fail_exit("--workers needs an output prefix, not stdout");
+      }
+
+      int status;
+      if(!fork_workers(nworkers, &start_frame, &end_frame, &status)) {
+        return status;
+      }
+    }
+  }
+
+  // without a window the only thing we can do is dump frames
+#ifdef BUILD_SDL
+  if(software && !output_prefix) usage(argv[0]);
+#else
+  if(!output_prefix) usage(argv[0]);
+#endif
+
+  // the impostor is a GL program, --raycast is its CPU counterpart
+  if(use_impostor && software) usage(argv[0]);
+
+  // the CPU renderers always shade with every feature
+  if(scene_features != ADS_ALL && software) usage(argv[0]);
+  if(watch_shaders && software) usage(argv[0]);
+
+  // after forking so each worker traces itself
+  trace_init(nworkers > 1);
+  trace_thread_name("main");
+
+  if(!software) init_gl(nworkers > 1);
+  if(watch_shaders) watch_programs();
+
+
+  unsigned lats = 90;
+  unsigned lons = 90;
+  double lat_step = M_PI / lats;
+  double lon_step = 2 * M_PI / lons;
+
+  Points points;
+  Points normals;
+  Points tangents;
+  TexCoords tcoords;
+
+  float alt = 0;
+  Vector axis(0,0,1);
+
+  {
+    TRACE_ZONE("build mesh");
+    for(unsigned ilat = 0; ilat < lats; ++ilat) {
+      float hlat = -M_PI/2 + lat_step * ilat;
+      float nlat = hlat + lat_step;
+
+      float rhlat = 1.0f - float(ilat) / float(lats);
+      float rnlat = 1.0f - float(ilat+1) / float(lats);
+
+      for(unsigned ilon = 0; ilon < lons; ++ilon) {
+        // generate a quad "here" to "next"
+        float hlon = -M_PI + lon_step * ilon;
+        float nlon = hlon + lon_step;
+
+        float rhlon = float(ilon) / float(lons);
+        float rnlon  = float(ilon+1) / float(lons);
+
+        points.push_back(Point::fromLatLon(hlat, hlon, alt));
+        tcoords.push_back(TexCoord(rhlon, rhlat));
+        Vector n1 = Point::fromLatLon(hlat, hlon, alt).norm();
+        normals.push_back(n1);
+        tangents.push_back(axis.cross(n1));
+
+        points.push_back(Point::fromLatLon(nlat, nlon, alt));
+        tcoords.push_back(TexCoord(rnlon, rnlat));
+        Vector n3 = Point::fromLatLon(nlat, nlon, alt).norm();
+        normals.push_back(n3);
+        tangents.push_back(axis.cross(n3));
+
+        points.push_back(Point::fromLatLon(nlat, hlon, alt));
+        tcoords.push_back(TexCoord(rhlon, rnlat));
+        Vector n2 = Point::fromLatLon(nlat, hlon, alt).norm();
+        normals.push_back(n2);
+        tangents.push_back(axis.cross(n2));
+
+        points.push_back(Point::fromLatLon(nlat, nlon, alt));
+        tcoords.push_back(TexCoord(rnlon, rnlat));
+        Vector n4 = Point::fromLatLon(nlat, nlon, alt).norm();
+        normals.push_back(n4);
+        tangents.push_back(axis.cross(n4));
+
+        points.push_back(Point::fromLatLon(hlat, hlon, alt));
+        tcoords.push_back(TexCoord(rhlon, rhlat));
+        Vector n6 = Point::fromLatLon(hlat, hlon, alt).norm();
+        normals.push_back(n6);
+        tangents.push_back(axis.cross(n6));
+
+        points.push_back(Point::fromLatLon(hlat, nlon, alt));
+        tcoords.push_back(TexCoord(rnlon, rhlat));
+        Vector n5 = Point::fromLatLon(hlat, nlon, alt).norm();
+        normals.push_back(n5);
+        tangents.push_back(axis.cross(n5));
+      }
+    }
+  }
+
+  points_size = points.size();
 
   // build a full screen quad
   float qpoints[] = {
@@ -297,11 +702,36 @@ int main(int argc, char** argv) {
     1, -1, 0.99
   };
 
-  glGenBuffers(1, &qverts);
-  gl_check(glBindBuffer(GL_ARRAY_BUFFER, qverts));
-  gl_check(glBufferData(GL_ARRAY_BUFFER, sizeof(qpoints), qpoints, GL_DYNAMIC_DRAW));
-
-  angle = 0;
+  CpuRenderer* sw = NULL;
+  ThreadPool* pool = NULL;
+  Image* sw_images[9];
+  if(software) {
+    pool = new ThreadPool(nthreads ? nthreads : ThreadPool::default_size());
+    const char* names[9] = {"world.png", "EarthNormSpec.png", "earth_lights.png",
+                            "purplenebula_left.jpg", "purplenebula_right.jpg",
+                            "purplenebula_top.jpg", "purplenebula_top.jpg",
+                            "purplenebula_front.jpg", "purplenebula_back.jpg"};
+    for(unsigned ii = 0; ii < 9; ++ii) {
+      sw_images[ii] = Image::from_file(names[ii]);
+    }
+    if(raycast) {
+      sw = new RaycastRenderer(pool, sw_images[0], sw_images[1], sw_images[2], sw_images + 3);
+    } else {
+      SoftwareRenderer* raster = new SoftwareRenderer(pool, sw_images[0], sw_images[1],
+                                                      sw_images[2], sw_images + 3);
+      // normals get the positions, exactly what upload_globe hands GL
+      raster->set_mesh(points, points, tangents, tcoords);
+      sw = raster;
+    }
+    LOGI("software %s on %u threads", raycast ? "raycasting" : "rendering", pool->size());
+  } else {
+    upload_globe(points, normals, tangents, tcoords);
+    load_gl_textures();
+
+    glGenBuffers(1, &qverts);
+    gl_state.bind_buffer(GL_ARRAY_BUFFER, qverts);
+    gl_check(glBufferData(GL_ARRAY_BUFFER, sizeof(qpoints), qpoints, GL_DYNAMIC_DRAW));
+  }
 
   // render loop
   unsigned fcount = 0;
@@ -309,16 +739,36 @@ int main(int argc, char** argv) {
   Time last_frame;
 
   FBO* fbo = NULL;
-  if(output_prefix) {
-    fbo = new FBO(screen_width, screen_height, GL_RGBA);
+  Image* strip = NULL;
+  if(output_prefix && software) {
+    strip = new Image(output_width, std::min(tile_size, output_height), 3);
+
+    camera.setAspect(float(output_width) / float(output_height));
+  } else if(output_prefix) {
+    GLint max_renderbuffer, max_texture, max_viewport[2];
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &max_renderbuffer);
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_texture);
+    glGetIntegerv(GL_MAX_VIEWPORT_DIMS, max_viewport);
+    tile_size = std::min(tile_size, (unsigned)max_renderbuffer);
+    tile_size = std::min(tile_size, (unsigned)max_texture);
+    tile_size = std::min(tile_size, (unsigned)std::min(max_viewport[0], max_viewport[1]));
+
+    unsigned tile_w = std::min(tile_size, output_width);
+    unsigned tile_h = std::min(tile_size, output_height);
+    fbo = new FBO(tile_w, tile_h, GL_RGBA);
+    strip = new Image(output_width, tile_h, 3);
+
+    camera.setAspect(float(output_width) / float(output_height));
+
+    if(tile_w < output_width || tile_h < output_height) {
+      LOGI("rendering %ux%u in %ux%u tiles", output_width, output_height, tile_w, tile_h);
+    }
   }
 
   //perspective.set_identity();
 
-  unsigned frame = 0;
-  camera.pos = Vector(0, 0, 10);
-  camera.look = Vector(0, 0, -1);
-  camera.up = Vector(0, 1, 0);
+  unsigned frame = start_frame;
+  set_frame_state(frame);
   /*
   perspective.print();
   printf("\n");
@@ -346,16 +796,23 @@ int main(int argc, char** argv) {
   bool up = false;
   bool down = false;
 
-  SDL_WM_GrabInput(SDL_GRAB_ON);
-  SDL_ShowCursor(SDL_DISABLE);
+#ifdef BUILD_SDL
+  if(!software) {
+    SDL_WM_GrabInput(SDL_GRAB_ON);
+    SDL_ShowCursor(SDL_DISABLE);
+  }
+#endif
 
   while(true) {
-    SDL_Event event;
+    TRACE_ZONE("frame");
     float xrel = 0.0f;
     float yrel = 0.0f;
 
+#ifdef BUILD_SDL
+    SDL_Event event;
+
     /* pump the events */
-    while(SDL_PollEvent(&event)) {
+    while(!software && SDL_PollEvent(&event)) {
       switch(event.type) {
       case SDL_QUIT:
         exit(0);
@@ -387,16 +844,18 @@ int main(int argc, char** argv) {
         break;
       }
     }
+#endif
+
+    // edited shaders are swapped in as they finish compiling
+    if(watch_shaders) reload_programs();
+
+    // the last frame's passes have all been issued
+    if(!software) gpu_timers.next_frame();
 
     fcount++;
     Time now;
 
-    TimeLength dt;
-    if(fbo) {
-      dt = TimeLength::inSeconds(1.0/60.0);
-    } else {
-      dt = now - last_frame;
-    }
+    TimeLength dt = now - last_frame;
     last_frame = now;
 
     float speed = 0.05;
@@ -407,14 +866,22 @@ int main(int argc, char** argv) {
     if(up) speedz = speed;
     if(down) speedz = -speed;
 
-    const float maxrot = 1.0;
-    if(abs(yrel) > 0) camera.rotateX(absclamp(yrel, maxrot) * dt.seconds());
-    if(abs(xrel) > 0) camera.rotateY(absclamp(-xrel, maxrot) * dt.seconds());
+    if(sink) {
+      // frames an earlier run already finished are skipped outright. the
+      // state of the next missing one comes straight from its index.
+      while(frame < end_frame && sink->is_done(frame)) frame++;
+      if(frame == end_frame) break;
 
-    //camera.forceUp(Vector(0, 1, 0));
-    camera.normalize();
-    camera.moveForward(speedz);
-    camera.moveRight(speedx);
+      set_frame_state(frame);
+    } else {
+      const float maxrot = 1.0;
+      if(abs(yrel) > 0) camera.rotateX(absclamp(yrel, maxrot) * dt.seconds());
+      if(abs(xrel) > 0) camera.rotateY(absclamp(-xrel, maxrot) * dt.seconds());
+
+      //camera.forceUp(Vector(0, 1, 0));
+      camera.moveForward(speedz);
+      camera.moveRight(speedx);
+    }
 
     /*
     printf("look: %s  up: %s\n", camera.look.str().c_str(), camera.up.str().c_str());
@@ -436,27 +903,40 @@ int main(int argc, char** argv) {
       }
     }
 
-    if(fbo) fbo->bind();
-
-    render_frame(dt);
-
-    if(fbo) {
-      fbo->unbind();
-
-      if(strcmp(output_prefix, "-") == 0) {
-        fbo->to_ppm_file(stdout);
+    if(!sink) {
+      render_frame();
+      angle = fmod(angle + dt.seconds() * rotation_rate, 2 * M_PI);
+      scene_time += dt.seconds();
+    } else {
+      if(software) {
+        render_software(sw, strip, sink, frame);
       } else {
-        char fname[256];
-        snprintf(fname, sizeof(fname), "%s_%06d.ppm", output_prefix, frame);
-        fbo->to_ppm(fname);
+        render_tiled(fbo, strip, sink, frame);
       }
 
       frame++;
-      if(frame == output_frames) break;
+      if(frame == end_frame) break;
     }
   }
 
   if(fbo) delete fbo;
+  if(strip) delete strip;
+  if(sink) delete sink;
+
+  if(sw) {
+    delete sw;
+    delete pool;
+    for(unsigned ii = 0; ii < 9; ++ii) delete sw_images[ii];
+  }
+
+  if(!software) {
+    gl_state.report();
+    gpu_timers.report();
+  }
+
+#ifndef BUILD_SDL
+  if(!software) headless_shutdown();
+#endif
 
   return 0;
 }
@@ -1,7 +1,5 @@
 #include "matrix.h"
-
-static float DetIJ(const Matrix& m, const int i, const int j);
-void m3dInvertMatrix44(Matrix& mInverse, const Matrix& m);
+#include "matrix_kernels.h"
 
 Matrix::Matrix() {
   set_identity();
@@ -33,57 +31,27 @@ Matrix Matrix::translation(float x, float y, float z) {
   return m;
 }
 
-Matrix Matrix::operator*(const Matrix& o) {
+Matrix Matrix::operator*(const Matrix& o) const {
   Matrix result;
-  for(unsigned ii = 0; ii < 4; ++ii) {
-    for(unsigned jj = 0; jj < 4; ++jj) {
-      result.elm(ii,jj) = 0;
-      for(unsigned kk = 0; kk < 4; ++kk) {
-        result.elm(ii,jj) += elm(ii,kk) * o.elm(kk,jj);
-      }
-    }
-  }
+  matrix_kernels()->multiply(data, o.data, result.data);
   return result;
 }
 
-Matrix Matrix::invertspecial() {
+Matrix Matrix::invertspecial() const {
   Matrix result;
+  matrix_kernels()->invert_rigid(data, result.data);
+  return result;
+}
 
-  // rotation component is the transpose
-  result.elm(0,0) = elm(0,0);
-  result.elm(0,1) = elm(1,0);
-  result.elm(0,2) = elm(2,0);
-
-  result.elm(1,0) = elm(0,1);
-  result.elm(1,1) = elm(1,1);
-  result.elm(1,2) = elm(2,1);
-
-  result.elm(2,0) = elm(0,2);
-  result.elm(2,1) = elm(1,2);
-  result.elm(2,2) = elm(2,2);
-
-  // translation component is displacement negated and rotated
-  result.elm(0,3) = -(elm(0,3) * result.elm(0,0) +
-                      elm(1,3) * result.elm(0,1) +
-                      elm(2,3) * result.elm(0,2));
-  result.elm(1,3) = -(elm(0,3) * result.elm(1,0) +
-                      elm(1,3) * result.elm(1,1) +
-                      elm(2,3) * result.elm(1,2));
-  result.elm(2,3) = -(elm(0,3) * result.elm(2,0) +
-                      elm(1,3) * result.elm(2,1) +
-                      elm(2,3) * result.elm(2,2));
-
-  // and the bottom row
-  result.elm(3,0) = 0;
-  result.elm(3,1) = 0;
-  result.elm(3,2) = 0;
-  result.elm(3,3) = 1;
+Matrix Matrix::invert_affine() const {
+  Matrix result;
+  matrix_kernels()->invert_affine(data, result.data);
   return result;
 }
 
-Matrix Matrix::invert() {
+Matrix Matrix::invert() const {
   Matrix result;
-  m3dInvertMatrix44(result, *this);
+  matrix_kernels()->invert(data, result.data);
   return result;
 }
 
@@ -111,23 +79,21 @@ void Matrix::set_row(unsigned r, const Vector& v) {
   elm(r,2) = v.z;
 }
 
-Vector Matrix::operator*(const Vector& o) {
-  Vector result;
-  result.x = o.x * elm(0,0) + o.y * elm(0,1) + o.z * elm(0,2) + elm(0,3);
-  result.y = o.x * elm(1,0) + o.y * elm(1,1) + o.z * elm(1,2) + elm(1,3);
-  result.z = o.x * elm(2,0) + o.y * elm(2,1) + o.z * elm(2,2) + elm(2,3);
-  return result;
+Vector Matrix::operator*(const Vector& o) const {
+  Vector4 result = *this * Vector4(o.x, o.y, o.z, 1);
+  return Vector(result.x, result.y, result.z);
 }
 
-Vector4 Matrix::operator*(const Vector4& o) {
+Vector4 Matrix::operator*(const Vector4& o) const {
   Vector4 result;
-  result.x = o.x * elm(0,0) + o.y * elm(0,1) + o.z * elm(0,2) + o.w * elm(0,3);
-  result.y = o.x * elm(1,0) + o.y * elm(1,1) + o.z * elm(1,2) + o.w * elm(1,3);
-  result.z = o.x * elm(2,0) + o.y * elm(2,1) + o.z * elm(2,2) + o.w * elm(2,3);
-  result.w = o.x * elm(3,0) + o.y * elm(3,1) + o.z * elm(3,2) + o.w * elm(3,3);
+  matrix_kernels()->transform(data, &o.x, &result.x, 1);
   return result;
 }
 
+void Matrix::transform(const Vector4* in, Vector4* out, unsigned n) const {
+  matrix_kernels()->transform(data, &in->x, &out->x, n);
+}
+
 void Matrix::set_rotation(float angle, const Vector& v) {
   Vector n = v.norm();
   float s = float(sin(angle));
@@ -170,52 +136,6 @@ std::string Matrix::str() const {
                    elm(3,0), elm(3,1), elm(3,2), elm(3,3));
 }
 
-// lifted from opengl superbible
-static float DetIJ(const Matrix& m, const int i, const int j) {
-  int x, y, ii, jj;
-  float ret, mat[3][3];
-
-  x = 0;
-  for (ii = 0; ii < 4; ii++) {
-    if (ii == i) continue;
-    y = 0;
-    for (jj = 0; jj < 4; jj++) {
-      if (jj == j) continue;
-      mat[x][y] = m.data[(ii*4)+jj];
-      y++;
-    }
-    x++;
-  }
-
-  ret =  mat[0][0]*(mat[1][1]*mat[2][2]-mat[2][1]*mat[1][2]);
-  ret -= mat[0][1]*(mat[1][0]*mat[2][2]-mat[2][0]*mat[1][2]);
-  ret += mat[0][2]*(mat[1][0]*mat[2][1]-mat[2][0]*mat[1][1]);
-
-  return ret;
-}
-
-inline void m3dInvertMatrix44(Matrix& mInverse, const Matrix& m) {
-  int i, j;
-  float det, detij;
-
-  // calculate 4x4 determinant
-  det = 0.0f;
-  for (i = 0; i < 4; i++) {
-    det += (i & 0x1) ? (-m.data[i] * DetIJ(m, 0, i)) : (m.data[i] * DetIJ(m, 0,i));
-  }
-  det = 1.0f / det;
-
-  // calculate inverse
-  for (i = 0; i < 4; i++) {
-    for (j = 0; j < 4; j++) {
-      detij = DetIJ(m, j, i);
-      mInverse.data[(i*4)+j] = ((i+j) & 0x1) ? (-detij * det) : (detij *det);
-    }
-  }
-}
-
-
-
 Quaternion::Quaternion(float w, float x, float y, float z)
   : w(w), x(x), y(y), z(z) {
 }
@@ -231,6 +151,53 @@ Quaternion Quaternion::rotation(float angle, const Vector& axis) {
   return Quaternion(cangle, axis.x * sangle, axis.y * sangle, axis.z * sangle);
 }
 
+Quaternion Quaternion::fromAxes(const Vector& x, const Vector& y, const Vector& z) {
+  // the axes are the columns of the rotation matrix. take the square
+  // root of whichever diagonal term keeps it well away from zero.
+  float trace = x.x + y.y + z.z;
+  if(trace > 0) {
+    float s = sqrtf(trace + 1) * 2;
+    return Quaternion(s / 4, (y.z - z.y) / s, (z.x - x.z) / s, (x.y - y.x) / s);
+  } else if(x.x > y.y && x.x > z.z) {
+    float s = sqrtf(1 + x.x - y.y - z.z) * 2;
+    return Quaternion((y.z - z.y) / s, s / 4, (y.x + x.y) / s, (z.x + x.z) / s);
+  } else if(y.y > z.z) {
+    float s = sqrtf(1 + y.y - x.x - z.z) * 2;
+    return Quaternion((z.x - x.z) / s, (y.x + x.y) / s, s / 4, (z.y + y.z) / s);
+  } else {
+    float s = sqrtf(1 + z.z - x.x - y.y) * 2;
+    return Quaternion((x.y - y.x) / s, (z.x + x.z) / s, (z.y + y.z) / s, s / 4);
+  }
+}
+
+Quaternion Quaternion::slerp(const Quaternion& a, const Quaternion& b, float t) {
+  // q and -q are the same rotation, pick the one nearer a
+  float d = a.dot(b);
+  float sign = 1;
+  if(d < 0) {
+    d = -d;
+    sign = -1;
+  }
+
+  float wa, wb;
+  if(d > 0.9995f) {
+    // nearly the same, a plain lerp is as good and doesn't divide by ~0
+    wa = 1 - t;
+    wb = t;
+  } else {
+    float theta = acosf(d);
+    float s = sinf(theta);
+    wa = sinf((1 - t) * theta) / s;
+    wb = sinf(t * theta) / s;
+  }
+  wb *= sign;
+
+  Quaternion result(wa * a.w + wb * b.w, wa * a.x + wb * b.x,
+                    wa * a.y + wb * b.y, wa * a.z + wb * b.z);
+  result.normalize();
+  return result;
+}
+
 Quaternion Quaternion::operator*(const Quaternion& o) const {
   float nw = w * o.w - x * o.x - y * o.y - z * o.z;
   float nx = w * o.x + x * o.w + y * o.z - z * o.y;
@@ -241,13 +208,21 @@ Quaternion Quaternion::operator*(const Quaternion& o) const {
 }
 
 Vector Quaternion::operator*(const Vector& v) const {
-  return matrix() * v;
+  // v + 2w(u x v) + 2u x (u x v) with u the vector part, much cheaper
+  // than building the matrix
+  Vector u(x, y, z);
+  Vector t = u.cross(v) * 2.0f;
+  return v + t * w + u.cross(t);
 }
 
 Quaternion Quaternion::conj() const {
   return Quaternion(w, -x, -y, -z);
 }
 
+float Quaternion::dot(const Quaternion& o) const {
+  return w * o.w + x * o.x + y * o.y + z * o.z;
+}
+
 float Quaternion::magnitude() const {
   return sqrt(w * w + x * x + y * y + z * z);
 }
@@ -28,11 +28,15 @@ public:
     return data[c*4+r];
   }
 
-  Matrix operator*(const Matrix& o);
+  Matrix operator*(const Matrix& o) const;
 
-  Matrix invertspecial();
+  // rotation plus translation only
+  Matrix invertspecial() const;
 
-  Matrix invert();
+  // any matrix whose bottom row is 0 0 0 1, scale and shear included
+  Matrix invert_affine() const;
+
+  Matrix invert() const;
 
   void set_scale(float x, float y, float z);
 
@@ -42,9 +46,12 @@ public:
 
   void set_row(unsigned r, const Vector& v);
 
-  Vector operator*(const Vector& o);
+  Vector operator*(const Vector& o) const;
+
+  Vector4 operator*(const Vector4& o) const;
 
-  Vector4 operator*(const Vector4& o);
+  // out[ii] = this * in[ii], in may be out
+  void transform(const Vector4* in, Vector4* out, unsigned n) const;
 
   void set_rotation(float angle, const Vector& v);
 
@@ -60,11 +67,21 @@ public:
 
   static Quaternion rotation(float angle, const Vector& axis);
 
+  // the rotation taking the unit x, y and z axes to the given
+  // orthonormal ones
+  static Quaternion fromAxes(const Vector& x, const Vector& y, const Vector& z);
+
+  // constant speed interpolation from a (t = 0) to b (t = 1) along the
+  // shorter arc
+  static Quaternion slerp(const Quaternion& a, const Quaternion& b, float t);
+
   Quaternion operator*(const Quaternion& other) const;
   Vector operator*(const Vector& other) const;
 
   Quaternion conj() const;
 
+  float dot(const Quaternion& o) const;
+
   float magnitude() const;
 
   void normalize();
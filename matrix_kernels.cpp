@@ -0,0 +1,562 @@
+#include "matrix_kernels.h"
+#include "simd.h"
+#include "utils.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the general inverse is the 2x2 block method: with M = | A B | the
+//                                                       | C D |
+// inverse is built from the adjugates and determinants of the blocks,
+// about half the multiplies of cofactor expansion. the scalar version
+// works lane by lane exactly like the SSE one does.
+
+struct v4 {
+  float v[4];
+};
+
+static inline v4 make(float a, float b, float c, float d) {
+  v4 r = {{a, b, c, d}};
+  return r;
+}
+
+static inline v4 add(const v4& a, const v4& b) {
+  return make(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]);
+}
+
+static inline v4 sub(const v4& a, const v4& b) {
+  return make(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]);
+}
+
+static inline v4 mul(const v4& a, const v4& b) {
+  return make(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]);
+}
+
+static inline v4 swz(const v4& a, int x, int y, int z, int w) {
+  return make(a.v[x], a.v[y], a.v[z], a.v[w]);
+}
+
+// x and y from a, z and w from b like _mm_shuffle_ps
+static inline v4 shuf(const v4& a, const v4& b, int x, int y, int z, int w) {
+  return make(a.v[x], a.v[y], b.v[z], b.v[w]);
+}
+
+// 2x2 matrices are (m00, m01, m10, m11). a * b
+static inline v4 mat2_mul(const v4& a, const v4& b) {
+  return add(mul(a, swz(b, 0,3,0,3)), mul(swz(a, 1,0,3,2), swz(b, 2,1,2,1)));
+}
+
+// adj(a) * b
+static inline v4 mat2_adj_mul(const v4& a, const v4& b) {
+  return sub(mul(swz(a, 3,3,0,0), b), mul(swz(a, 1,1,2,2), swz(b, 2,3,0,1)));
+}
+
+// a * adj(b)
+static inline v4 mat2_mul_adj(const v4& a, const v4& b) {
+  return sub(mul(a, swz(b, 3,0,3,0)), mul(swz(a, 1,0,3,2), swz(b, 2,1,2,1)));
+}
+
+static void multiply_scalar(const float* a, const float* b, float* out) {
+  for(unsigned jj = 0; jj < 4; ++jj) {
+    for(unsigned ii = 0; ii < 4; ++ii) {
+      float sum = a[ii] * b[jj*4];
+      for(unsigned kk = 1; kk < 4; ++kk) {
+        sum += a[kk*4+ii] * b[jj*4+kk];
+      }
+      out[jj*4+ii] = sum;
+    }
+  }
+}
+
+// the block method works on rows, but the inverse of the transpose is
+// the transpose of the inverse so our columns can stand in for them
+static void invert_scalar(const float* m, float* out) {
+  v4 r0 = make(m[0], m[1], m[2], m[3]);
+  v4 r1 = make(m[4], m[5], m[6], m[7]);
+  v4 r2 = make(m[8], m[9], m[10], m[11]);
+  v4 r3 = make(m[12], m[13], m[14], m[15]);
+
+  v4 A = shuf(r0, r1, 0,1,0,1);
+  v4 B = shuf(r0, r1, 2,3,2,3);
+  v4 C = shuf(r2, r3, 0,1,0,1);
+  v4 D = shuf(r2, r3, 2,3,2,3);
+
+  // |A| |B| |C| |D|
+  v4 det = sub(mul(shuf(r0, r2, 0,2,0,2), shuf(r1, r3, 1,3,1,3)),
+               mul(shuf(r0, r2, 1,3,1,3), shuf(r1, r3, 0,2,0,2)));
+  v4 detA = swz(det, 0,0,0,0);
+  v4 detB = swz(det, 1,1,1,1);
+  v4 detC = swz(det, 2,2,2,2);
+  v4 detD = swz(det, 3,3,3,3);
+
+  v4 D_C = mat2_adj_mul(D, C);
+  v4 A_B = mat2_adj_mul(A, B);
+  v4 X_ = sub(mul(detD, A), mat2_mul(B, D_C));
+  v4 W_ = sub(mul(detA, D), mat2_mul(C, A_B));
+  v4 Y_ = sub(mul(detB, C), mat2_mul_adj(D, A_B));
+  v4 Z_ = sub(mul(detC, B), mat2_mul_adj(A, D_C));
+
+  // |M| = |A||D| + |B||C| - tr(A#B D#C)
+  v4 tr = mul(A_B, swz(D_C, 0,2,1,3));
+  tr = add(tr, swz(tr, 1,0,3,2));
+  tr = add(tr, swz(tr, 2,3,0,1));
+  v4 detM = sub(add(mul(detA, detD), mul(detB, detC)), tr);
+
+  v4 rdet = make(1.0f / detM.v[0], -1.0f / detM.v[1], -1.0f / detM.v[2], 1.0f / detM.v[3]);
+  X_ = mul(X_, rdet);
+  Y_ = mul(Y_, rdet);
+  Z_ = mul(Z_, rdet);
+  W_ = mul(W_, rdet);
+
+  v4 o0 = shuf(X_, Y_, 3,1,3,1);
+  v4 o1 = shuf(X_, Y_, 2,0,2,0);
+  v4 o2 = shuf(Z_, W_, 3,1,3,1);
+  v4 o3 = shuf(Z_, W_, 2,0,2,0);
+  memcpy(out, o0.v, sizeof(o0.v));
+  memcpy(out + 4, o1.v, sizeof(o1.v));
+  memcpy(out + 8, o2.v, sizeof(o2.v));
+  memcpy(out + 12, o3.v, sizeof(o3.v));
+}
+
+static void invert_rigid_scalar(const float* m, float* out) {
+  // rotation component is the transpose
+  for(unsigned ii = 0; ii < 3; ++ii) {
+    for(unsigned jj = 0; jj < 3; ++jj) {
+      out[jj*4+ii] = m[ii*4+jj];
+    }
+    out[ii*4+3] = 0;
+  }
+
+  // translation component is displacement negated and rotated
+  for(unsigned ii = 0; ii < 3; ++ii) {
+    out[12+ii] = -(m[12] * out[ii] + m[13] * out[4+ii] + m[14] * out[8+ii]);
+  }
+  out[15] = 1;
+}
+
+// the rows of the 3x3 inverse are the cross products of its columns
+// over the determinant
+static void invert_affine_scalar(const float* m, float* out) {
+  const float* a = m;
+  const float* b = m + 4;
+  const float* c = m + 8;
+  float bc[3] = {b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0]};
+  float ca[3] = {c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0]};
+  float ab[3] = {a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0]};
+  float rdet = 1.0f / (a[0] * bc[0] + a[1] * bc[1] + a[2] * bc[2]);
+
+  for(unsigned jj = 0; jj < 3; ++jj) {
+    out[jj*4] = bc[jj] * rdet;
+    out[jj*4+1] = ca[jj] * rdet;
+    out[jj*4+2] = ab[jj] * rdet;
+    out[jj*4+3] = 0;
+  }
+
+  for(unsigned ii = 0; ii < 3; ++ii) {
+    out[12+ii] = -(m[12] * out[ii] + m[13] * out[4+ii] + m[14] * out[8+ii]);
+  }
+  out[15] = 1;
+}
+
+static void transform_scalar(const float* m, const float* in, float* out, unsigned n) {
+  for(unsigned vv = 0; vv < n; ++vv) {
+    float x = in[0], y = in[1], z = in[2], w = in[3];
+    for(unsigned ii = 0; ii < 4; ++ii) {
+      out[ii] = x * m[ii] + y * m[4+ii] + z * m[8+ii] + w * m[12+ii];
+    }
+    in += 4;
+    out += 4;
+  }
+}
+
+static void transform_soa_scalar(const float* m, float w, unsigned n,
+                                 const float* x, const float* y, const float* z,
+                                 float* ox, float* oy, float* oz) {
+  for(unsigned ii = 0; ii < n; ++ii) {
+    float px = x[ii], py = y[ii], pz = z[ii];
+    ox[ii] = px * m[0] + py * m[4] + pz * m[8] + w * m[12];
+    oy[ii] = px * m[1] + py * m[5] + pz * m[9] + w * m[13];
+    oz[ii] = px * m[2] + py * m[6] + pz * m[10] + w * m[14];
+  }
+}
+
+static void project_soa_scalar(const float* m, float sx, float sy, unsigned n,
+                               const float* x, const float* y, const float* z,
+                               float* ox, float* oy, float* oz) {
+  float hx = 0.5f * sx, hy = 0.5f * sy;
+  for(unsigned ii = 0; ii < n; ++ii) {
+    float px = x[ii], py = y[ii], pz = z[ii];
+    float cw = px * m[3] + py * m[7] + pz * m[11] + m[15];
+    if(!(cw > 0)) {
+      ox[ii] = oy[ii] = oz[ii] = NAN;
+      continue;
+    }
+
+    float iw = 1.0f / cw;
+    float cx = px * m[0] + py * m[4] + pz * m[8] + m[12];
+    float cy = px * m[1] + py * m[5] + pz * m[9] + m[13];
+    float cz = px * m[2] + py * m[6] + pz * m[10] + m[14];
+    ox[ii] = (cx * iw + 1) * hx;
+    oy[ii] = (cy * iw + 1) * hy;
+    oz[ii] = cz * iw;
+  }
+}
+
+static const MatrixKernels scalar_kernels = {
+  "scalar", multiply_scalar, invert_scalar, invert_rigid_scalar, invert_affine_scalar,
+  transform_scalar, transform_soa_scalar, project_soa_scalar
+};
+
+#ifdef SIMD_SSE
+
+#define SHUFFLE(a, b, x, y, z, w) _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x))
+#define SWIZZLE(a, x, y, z, w) SHUFFLE(a, a, x, y, z, w)
+
+static inline __m128 sse_mat2_mul(__m128 a, __m128 b) {
+  return _mm_add_ps(_mm_mul_ps(a, SWIZZLE(b, 0,3,0,3)),
+                    _mm_mul_ps(SWIZZLE(a, 1,0,3,2), SWIZZLE(b, 2,1,2,1)));
+}
+
+static inline __m128 sse_mat2_adj_mul(__m128 a, __m128 b) {
+  return _mm_sub_ps(_mm_mul_ps(SWIZZLE(a, 3,3,0,0), b),
+                    _mm_mul_ps(SWIZZLE(a, 1,1,2,2), SWIZZLE(b, 2,3,0,1)));
+}
+
+static inline __m128 sse_mat2_mul_adj(__m128 a, __m128 b) {
+  return _mm_sub_ps(_mm_mul_ps(a, SWIZZLE(b, 3,0,3,0)),
+                    _mm_mul_ps(SWIZZLE(a, 1,0,3,2), SWIZZLE(b, 2,1,2,1)));
+}
+
+// column jj of the product is the columns of a weighted by column jj
+// of b, summed in the same order as the scalar loop
+static void multiply_sse(const float* a, const float* b, float* out) {
+  __m128 a0 = _mm_loadu_ps(a);
+  __m128 a1 = _mm_loadu_ps(a + 4);
+  __m128 a2 = _mm_loadu_ps(a + 8);
+  __m128 a3 = _mm_loadu_ps(a + 12);
+
+  for(unsigned jj = 0; jj < 4; ++jj) {
+    const float* bc = b + jj*4;
+    __m128 sum = _mm_mul_ps(a0, _mm_set1_ps(bc[0]));
+    sum = _mm_add_ps(sum, _mm_mul_ps(a1, _mm_set1_ps(bc[1])));
+    sum = _mm_add_ps(sum, _mm_mul_ps(a2, _mm_set1_ps(bc[2])));
+    sum = _mm_add_ps(sum, _mm_mul_ps(a3, _mm_set1_ps(bc[3])));
+    _mm_storeu_ps(out + jj*4, sum);
+  }
+}
+
+static void invert_sse(const float* m, float* out) {
+  __m128 r0 = _mm_loadu_ps(m);
+  __m128 r1 = _mm_loadu_ps(m + 4);
+  __m128 r2 = _mm_loadu_ps(m + 8);
+  __m128 r3 = _mm_loadu_ps(m + 12);
+
+  __m128 A = _mm_movelh_ps(r0, r1);
+  __m128 B = _mm_movehl_ps(r1, r0);
+  __m128 C = _mm_movelh_ps(r2, r3);
+  __m128 D = _mm_movehl_ps(r3, r2);
+
+  __m128 det = _mm_sub_ps(_mm_mul_ps(SHUFFLE(r0, r2, 0,2,0,2), SHUFFLE(r1, r3, 1,3,1,3)),
+                          _mm_mul_ps(SHUFFLE(r0, r2, 1,3,1,3), SHUFFLE(r1, r3, 0,2,0,2)));
+  __m128 detA = SWIZZLE(det, 0,0,0,0);
+  __m128 detB = SWIZZLE(det, 1,1,1,1);
+  __m128 detC = SWIZZLE(det, 2,2,2,2);
+  __m128 detD = SWIZZLE(det, 3,3,3,3);
+
+  __m128 D_C = sse_mat2_adj_mul(D, C);
+  __m128 A_B = sse_mat2_adj_mul(A, B);
+  __m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), sse_mat2_mul(B, D_C));
+  __m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), sse_mat2_mul(C, A_B));
+  __m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), sse_mat2_mul_adj(D, A_B));
+  __m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), sse_mat2_mul_adj(A, D_C));
+
+  __m128 tr = _mm_mul_ps(A_B, SWIZZLE(D_C, 0,2,1,3));
+  tr = _mm_add_ps(tr, SWIZZLE(tr, 1,0,3,2));
+  tr = _mm_add_ps(tr, SWIZZLE(tr, 2,3,0,1));
+  __m128 detM = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), tr);
+
+  __m128 rdet = _mm_div_ps(_mm_setr_ps(1.0f, -1.0f, -1.0f, 1.0f), detM);
+  X_ = _mm_mul_ps(X_, rdet);
+  Y_ = _mm_mul_ps(Y_, rdet);
+  Z_ = _mm_mul_ps(Z_, rdet);
+  W_ = _mm_mul_ps(W_, rdet);
+
+  _mm_storeu_ps(out, SHUFFLE(X_, Y_, 3,1,3,1));
+  _mm_storeu_ps(out + 4, SHUFFLE(X_, Y_, 2,0,2,0));
+  _mm_storeu_ps(out + 8, SHUFFLE(Z_, W_, 3,1,3,1));
+  _mm_storeu_ps(out + 12, SHUFFLE(Z_, W_, 2,0,2,0));
+}
+
+static void invert_rigid_sse(const float* m, float* out) {
+  __m128 c0 = _mm_loadu_ps(m);
+  __m128 c1 = _mm_loadu_ps(m + 4);
+  __m128 c2 = _mm_loadu_ps(m + 8);
+  __m128 c3 = _mm_setzero_ps();
+  _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+  // transposing put m's zero bottom row in the last lane
+  __m128 t = _mm_mul_ps(c0, _mm_set1_ps(m[12]));
+  t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(m[13])));
+  t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(m[14])));
+  t = _mm_xor_ps(t, _mm_set1_ps(-0.0f));
+
+  _mm_storeu_ps(out, c0);
+  _mm_storeu_ps(out + 4, c1);
+  _mm_storeu_ps(out + 8, c2);
+  _mm_storeu_ps(out + 12, t);
+  out[3] = out[7] = out[11] = 0;
+  out[15] = 1;
+}
+
+// same products in the same order as the scalar version
+static inline __m128 cross_sse(__m128 u, __m128 v) {
+  return _mm_sub_ps(_mm_mul_ps(SWIZZLE(u, 1,2,0,3), SWIZZLE(v, 2,0,1,3)),
+                    _mm_mul_ps(SWIZZLE(u, 2,0,1,3), SWIZZLE(v, 1,2,0,3)));
+}
+
+static void invert_affine_sse(const float* m, float* out) {
+  __m128 a = _mm_loadu_ps(m);
+  __m128 b = _mm_loadu_ps(m + 4);
+  __m128 c = _mm_loadu_ps(m + 8);
+  __m128 bc = cross_sse(b, c);
+  __m128 ca = cross_sse(c, a);
+  __m128 ab = cross_sse(a, b);
+
+  float p[4];
+  _mm_storeu_ps(p, _mm_mul_ps(a, bc));
+  __m128 rdet = _mm_set1_ps(1.0f / (p[0] + p[1] + p[2]));
+
+  // the rows, transposed into columns. the zero row ends up as the
+  // bottom row and the last column is replaced by the translation.
+  __m128 c0 = _mm_mul_ps(bc, rdet);
+  __m128 c1 = _mm_mul_ps(ca, rdet);
+  __m128 c2 = _mm_mul_ps(ab, rdet);
+  __m128 c3 = _mm_setzero_ps();
+  _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+
+  __m128 t = _mm_mul_ps(c0, _mm_set1_ps(m[12]));
+  t = _mm_add_ps(t, _mm_mul_ps(c1, _mm_set1_ps(m[13])));
+  t = _mm_add_ps(t, _mm_mul_ps(c2, _mm_set1_ps(m[14])));
+  t = _mm_xor_ps(t, _mm_set1_ps(-0.0f));
+
+  _mm_storeu_ps(out, c0);
+  _mm_storeu_ps(out + 4, c1);
+  _mm_storeu_ps(out + 8, c2);
+  _mm_storeu_ps(out + 12, t);
+  out[15] = 1;
+}
+
+static void transform_sse(const float* m, const float* in, float* out, unsigned n) {
+  __m128 c0 = _mm_loadu_ps(m);
+  __m128 c1 = _mm_loadu_ps(m + 4);
+  __m128 c2 = _mm_loadu_ps(m + 8);
+  __m128 c3 = _mm_loadu_ps(m + 12);
+
+  for(unsigned vv = 0; vv < n; ++vv) {
+    __m128 v = _mm_loadu_ps(in);
+    __m128 r = _mm_mul_ps(SWIZZLE(v, 0,0,0,0), c0);
+    r = _mm_add_ps(r, _mm_mul_ps(SWIZZLE(v, 1,1,1,1), c1));
+    r = _mm_add_ps(r, _mm_mul_ps(SWIZZLE(v, 2,2,2,2), c2));
+    r = _mm_add_ps(r, _mm_mul_ps(SWIZZLE(v, 3,3,3,3), c3));
+    _mm_storeu_ps(out, r);
+    in += 4;
+    out += 4;
+  }
+}
+
+// four points at a time, the rest go through the scalar loop which
+// rounds the same way
+static void transform_soa_sse(const float* m, float w, unsigned n,
+                              const float* x, const float* y, const float* z,
+                              float* ox, float* oy, float* oz) {
+  __m128 wv = _mm_set1_ps(w);
+  unsigned ii = 0;
+  for(; ii + 4 <= n; ii += 4) {
+    __m128 px = _mm_loadu_ps(x + ii);
+    __m128 py = _mm_loadu_ps(y + ii);
+    __m128 pz = _mm_loadu_ps(z + ii);
+    __m128 r[3];
+    for(unsigned cc = 0; cc < 3; ++cc) {
+      r[cc] = _mm_mul_ps(px, _mm_set1_ps(m[cc]));
+      r[cc] = _mm_add_ps(r[cc], _mm_mul_ps(py, _mm_set1_ps(m[4+cc])));
+      r[cc] = _mm_add_ps(r[cc], _mm_mul_ps(pz, _mm_set1_ps(m[8+cc])));
+      r[cc] = _mm_add_ps(r[cc], _mm_mul_ps(wv, _mm_set1_ps(m[12+cc])));
+    }
+    _mm_storeu_ps(ox + ii, r[0]);
+    _mm_storeu_ps(oy + ii, r[1]);
+    _mm_storeu_ps(oz + ii, r[2]);
+  }
+  transform_soa_scalar(m, w, n - ii, x + ii, y + ii, z + ii, ox + ii, oy + ii, oz + ii);
+}
+
+static void project_soa_sse(const float* m, float sx, float sy, unsigned n,
+                            const float* x, const float* y, const float* z,
+                            float* ox, float* oy, float* oz) {
+  __m128 hx = _mm_set1_ps(0.5f * sx), hy = _mm_set1_ps(0.5f * sy);
+  __m128 one = _mm_set1_ps(1.0f);
+  __m128 nan = _mm_set1_ps(NAN);
+  unsigned ii = 0;
+  for(; ii + 4 <= n; ii += 4) {
+    __m128 px = _mm_loadu_ps(x + ii);
+    __m128 py = _mm_loadu_ps(y + ii);
+    __m128 pz = _mm_loadu_ps(z + ii);
+    __m128 r[4];
+    for(unsigned cc = 0; cc < 4; ++cc) {
+      r[cc] = _mm_mul_ps(px, _mm_set1_ps(m[cc]));
+      r[cc] = _mm_add_ps(r[cc], _mm_mul_ps(py, _mm_set1_ps(m[4+cc])));
+      r[cc] = _mm_add_ps(r[cc], _mm_mul_ps(pz, _mm_set1_ps(m[8+cc])));
+      r[cc] = _mm_add_ps(r[cc], _mm_set1_ps(m[12+cc]));
+    }
+
+    __m128 front = _mm_cmpgt_ps(r[3], _mm_setzero_ps());
+    __m128 iw = _mm_div_ps(one, r[3]);
+    __m128 wx = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(r[0], iw), one), hx);
+    __m128 wy = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(r[1], iw), one), hy);
+    __m128 wz = _mm_mul_ps(r[2], iw);
+    _mm_storeu_ps(ox + ii, _mm_or_ps(_mm_and_ps(front, wx), _mm_andnot_ps(front, nan)));
+    _mm_storeu_ps(oy + ii, _mm_or_ps(_mm_and_ps(front, wy), _mm_andnot_ps(front, nan)));
+    _mm_storeu_ps(oz + ii, _mm_or_ps(_mm_and_ps(front, wz), _mm_andnot_ps(front, nan)));
+  }
+  project_soa_scalar(m, sx, sy, n - ii, x + ii, y + ii, z + ii, ox + ii, oy + ii, oz + ii);
+}
+
+static const MatrixKernels sse_kernels = {
+  "sse", multiply_sse, invert_sse, invert_rigid_sse, invert_affine_sse,
+  transform_sse, transform_soa_sse, project_soa_sse
+};
+
+// the avx versions are compiled for avx on their own so the rest of
+// the program still runs on any x86-64. no fma: it would round
+// differently from the other sets.
+#ifdef __GNUC__
+#define HAVE_AVX_KERNELS
+#include <immintrin.h>
+
+#define AVX_TARGET __attribute__((target("avx")))
+
+// two vectors at a time, the odd one out goes through sse
+static AVX_TARGET void transform_avx(const float* m, const float* in, float* out, unsigned n) {
+  __m256 c0 = _mm256_broadcast_ps((const __m128*)m);
+  __m256 c1 = _mm256_broadcast_ps((const __m128*)(m + 4));
+  __m256 c2 = _mm256_broadcast_ps((const __m128*)(m + 8));
+  __m256 c3 = _mm256_broadcast_ps((const __m128*)(m + 12));
+
+  unsigned vv = 0;
+  for(; vv + 2 <= n; vv += 2) {
+    __m256 v = _mm256_loadu_ps(in);
+    __m256 r = _mm256_mul_ps(_mm256_permute_ps(v, 0x00), c0);
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(v, 0x55), c1));
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(v, 0xaa), c2));
+    r = _mm256_add_ps(r, _mm256_mul_ps(_mm256_permute_ps(v, 0xff), c3));
+    _mm256_storeu_ps(out, r);
+    in += 8;
+    out += 8;
+  }
+  // the sse tail is legacy encoded, clear the upper halves first or the
+  // switch costs more than the whole batch when n is small
+  _mm256_zeroupper();
+  if(vv < n) transform_sse(m, in, out, n - vv);
+}
+
+// a single multiply or inverse is too small to gain from the wider
+// registers, only batches of vectors do
+static const MatrixKernels avx_kernels = {
+  "avx", multiply_sse, invert_sse, invert_rigid_sse, invert_affine_sse,
+  transform_avx, transform_soa_sse, project_soa_sse
+};
+
+#define FMA_TARGET __attribute__((target("avx,fma")))
+
+// eight points at a time with every row a chain of fused multiply-adds
+static FMA_TARGET void transform_soa_fma(const float* m, float w, unsigned n,
+                                         const float* x, const float* y, const float* z,
+                                         float* ox, float* oy, float* oz) {
+  float* out[3] = {ox, oy, oz};
+  unsigned ii = 0;
+  for(; ii + 8 <= n; ii += 8) {
+    __m256 px = _mm256_loadu_ps(x + ii);
+    __m256 py = _mm256_loadu_ps(y + ii);
+    __m256 pz = _mm256_loadu_ps(z + ii);
+    __m256 r[3];
+    for(unsigned cc = 0; cc < 3; ++cc) {
+      r[cc] = _mm256_set1_ps(w * m[12+cc]);
+      r[cc] = _mm256_fmadd_ps(pz, _mm256_set1_ps(m[8+cc]), r[cc]);
+      r[cc] = _mm256_fmadd_ps(py, _mm256_set1_ps(m[4+cc]), r[cc]);
+      r[cc] = _mm256_fmadd_ps(px, _mm256_set1_ps(m[cc]), r[cc]);
+    }
+    for(unsigned cc = 0; cc < 3; ++cc) _mm256_storeu_ps(out[cc] + ii, r[cc]);
+  }
+  _mm256_zeroupper();
+  transform_soa_sse(m, w, n - ii, x + ii, y + ii, z + ii, ox + ii, oy + ii, oz + ii);
+}
+
+static FMA_TARGET void project_soa_fma(const float* m, float sx, float sy, unsigned n,
+                                       const float* x, const float* y, const float* z,
+                                       float* ox, float* oy, float* oz) {
+  __m256 hx = _mm256_set1_ps(0.5f * sx), hy = _mm256_set1_ps(0.5f * sy);
+  __m256 nan = _mm256_set1_ps(NAN);
+  unsigned ii = 0;
+  for(; ii + 8 <= n; ii += 8) {
+    __m256 px = _mm256_loadu_ps(x + ii);
+    __m256 py = _mm256_loadu_ps(y + ii);
+    __m256 pz = _mm256_loadu_ps(z + ii);
+    __m256 r[4];
+    for(unsigned cc = 0; cc < 4; ++cc) {
+      r[cc] = _mm256_set1_ps(m[12+cc]);
+      r[cc] = _mm256_fmadd_ps(pz, _mm256_set1_ps(m[8+cc]), r[cc]);
+      r[cc] = _mm256_fmadd_ps(py, _mm256_set1_ps(m[4+cc]), r[cc]);
+      r[cc] = _mm256_fmadd_ps(px, _mm256_set1_ps(m[cc]), r[cc]);
+    }
+
+    __m256 front = _mm256_cmp_ps(r[3], _mm256_setzero_ps(), _CMP_GT_OQ);
+    __m256 iw = _mm256_div_ps(_mm256_set1_ps(1.0f), r[3]);
+    // (c / w + 1) * h as c / w * h + h
+    __m256 wx = _mm256_fmadd_ps(_mm256_mul_ps(r[0], iw), hx, hx);
+    __m256 wy = _mm256_fmadd_ps(_mm256_mul_ps(r[1], iw), hy, hy);
+    __m256 wz = _mm256_mul_ps(r[2], iw);
+    _mm256_storeu_ps(ox + ii, _mm256_blendv_ps(nan, wx, front));
+    _mm256_storeu_ps(oy + ii, _mm256_blendv_ps(nan, wy, front));
+    _mm256_storeu_ps(oz + ii, _mm256_blendv_ps(nan, wz, front));
+  }
+  _mm256_zeroupper();
+  project_soa_sse(m, sx, sy, n - ii, x + ii, y + ii, z + ii, ox + ii, oy + ii, oz + ii);
+}
+
+static const MatrixKernels fma_kernels = {
+  "fma", multiply_sse, invert_sse, invert_rigid_sse, invert_affine_sse,
+  transform_avx, transform_soa_fma, project_soa_fma
+};
+#endif
+
+#endif
+
+static const MatrixKernels* choose_kernels() {
+  const MatrixKernels* best = &scalar_kernels;
+#ifdef SIMD_SSE
+  best = &sse_kernels;
+#ifdef HAVE_AVX_KERNELS
+  if(__builtin_cpu_supports("avx")) best = &avx_kernels;
+  if(__builtin_cpu_supports("avx") && __builtin_cpu_supports("fma")) best = &fma_kernels;
+#endif
+#endif
+
+  const char* forced = getenv("MATRIX_KERNELS");
+  if(!forced) return best;
+
+  if(strcmp(forced, "scalar") == 0) return &scalar_kernels;
+#ifdef SIMD_SSE
+  if(strcmp(forced, "sse") == 0) return &sse_kernels;
+#ifdef HAVE_AVX_KERNELS
+  if(strcmp(forced, "avx") == 0 && best != &sse_kernels) return &avx_kernels;
+  if(strcmp(forced, "fma") == 0 && best == &fma_kernels) return &fma_kernels;
+#endif
+#endif
+  LOGW("MATRIX_KERNELS=%s isn't available here, using %s", forced, best->name);
+  return best;
+}
+
+const MatrixKernels* matrix_kernels() {
+  static const MatrixKernels* kernels = choose_kernels();
+  return kernels;
+}
@@ -0,0 +1,51 @@
+#ifndef MATRIX_KERNELS_H
+#define MATRIX_KERNELS_H
+
+// the 4x4 math behind Matrix, on column major float[16] like
+// Matrix::data. there is a scalar, an SSE, an AVX and an AVX+FMA set
+// and the fastest one the cpu supports is picked the first time they're
+// asked for. every set does the same operations in the same order so
+// they give bit identical results and frames don't depend on the
+// machine. the one exception is the fma set's structure of arrays
+// kernels, which fuse multiplies and adds and can differ in the last
+// bit. nothing that draws frames uses those.
+struct MatrixKernels {
+  const char* name;
+
+  // out = a * b. out may not alias a or b.
+  void (*multiply)(const float* a, const float* b, float* out);
+
+  // general inverse
+  void (*invert)(const float* m, float* out);
+
+  // inverse of a rotation plus translation, see Matrix::invertspecial.
+  // wrong for anything with scale or shear.
+  void (*invert_rigid)(const float* m, float* out);
+
+  // inverse of any matrix with a bottom row of 0 0 0 1: the upper 3x3
+  // by cofactors, the translation rotated back through it
+  void (*invert_affine)(const float* m, float* out);
+
+  // out[ii] = m * in[ii] for n vectors of 4 floats. in and out may be
+  // the same array.
+  void (*transform)(const float* m, const float* in, float* out, unsigned n);
+
+  // the same over structure of arrays: (ox, oy, oz) = m * (x, y, z, w)
+  // for n points, w is 1 for points and 0 for directions. the outputs
+  // may be the inputs.
+  void (*transform_soa)(const float* m, float w, unsigned n,
+                        const float* x, const float* y, const float* z,
+                        float* ox, float* oy, float* oz);
+
+  // m * (x, y, z, 1) divided through by w and mapped to a viewport of
+  // sx by sy, ndc depth in oz. points with w <= 0 are behind the eye
+  // and come out NaN.
+  void (*project_soa)(const float* m, float sx, float sy, unsigned n,
+                      const float* x, const float* y, const float* z,
+                      float* ox, float* oy, float* oz);
+};
+
+// MATRIX_KERNELS=scalar|sse|avx|fma in the environment forces a set
+const MatrixKernels* matrix_kernels();
+
+#endif
@@ -8,6 +8,11 @@
 
 #include <string>
 
+// the ellipsoid fromLatLon puts points on: equatorial radius and
+// eccentricity
+const float earth_rn = 1;
+const float earth_e = 0.081819190842621;
+
 class Point {
 public:
   float x, y, z;
@@ -22,8 +27,8 @@ public:
 
   // angles in radians
   inline static Point fromLatLon(double lat, double lon, double h = 0) {
-    float Rn = 1;
-    float E = 0.081819190842621;
+    float Rn = earth_rn;
+    float E = earth_e;
 
     float x = (Rn + h) * cos(lat) * cos(lon);
     float y = (Rn + h) * cos(lat) * sin(lon);
@@ -31,6 +36,32 @@ public:
     return Point(x, y, z);
   }
 
+  // the inverse of fromLatLon. heights there are added along each axis
+  // rather than along the surface normal, so (1+h) cos(lat) and
+  // (b+h) sin(lat) give the distance from the axis p and z, b being the
+  // polar radius. eliminating h leaves
+  //   p sin(lat) - z cos(lat) - (1 - b) sin(lat) cos(lat) = 0
+  // which Newton's method solves from the h = 0 answer in a few steps.
+  inline void toLatLon(double* lat, double* lon, double* h) const {
+    double a = earth_rn;
+    double b = (1 - earth_e*earth_e) * earth_rn;
+    double p = sqrt(double(x)*x + double(y)*y);
+
+    double l = atan2(a * z, b * p);
+    for(unsigned ii = 0; ii < 4; ++ii) {
+      double s = sin(l), c = cos(l);
+      double f = p*s - z*c - (a - b)*s*c;
+      double df = p*c + z*s - (a - b)*(c*c - s*s);
+      if(df == 0) break;
+      l -= f / df;
+    }
+
+    double s = sin(l), c = cos(l);
+    *lat = l;
+    *lon = atan2(double(y), double(x));
+    *h = p*c + z*s - (a*c*c + b*s*s);
+  }
+
   inline float dot(const Point& o) const {
     return x*o.x + y*o.y + z*o.z;
   }
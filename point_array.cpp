@@ -0,0 +1,85 @@
+#include "point_array.h"
+#include "matrix_kernels.h"
+
+#include <algorithm>
+
+// work items handed to the pool are this many points
+static const unsigned chunk_size = 16384;
+
+struct PointJob {
+  const float* m;
+  bool project;
+  // the w of transform_soa or the viewport of project_soa
+  float w, sx, sy;
+  unsigned n;
+  const PointArray* in;
+  PointArray* out;
+};
+
+static void run_chunk(const PointJob* job, unsigned start, unsigned count) {
+  const MatrixKernels* k = matrix_kernels();
+  const PointArray* in = job->in;
+  PointArray* out = job->out;
+
+  if(job->project) {
+    k->project_soa(job->m, job->sx, job->sy, count,
+                   &in->x[start], &in->y[start], &in->z[start],
+                   &out->x[start], &out->y[start], &out->z[start]);
+  } else {
+    k->transform_soa(job->m, job->w, count,
+                     &in->x[start], &in->y[start], &in->z[start],
+                     &out->x[start], &out->y[start], &out->z[start]);
+  }
+}
+
+static void chunk_job(void* ctx, unsigned index) {
+  const PointJob* job = (const PointJob*)ctx;
+  unsigned start = index * chunk_size;
+  unsigned count = std::min(chunk_size, job->n - start);
+  run_chunk(job, start, count);
+}
+
+static void run(PointJob* job, ThreadPool* pool) {
+  job->out->resize(job->n);
+  if(job->n == 0) return;
+
+  if(pool && pool->size() > 1 && job->n >= point_batch_threshold) {
+    pool->parallel_for((job->n + chunk_size - 1) / chunk_size, chunk_job, job);
+  } else {
+    run_chunk(job, 0, job->n);
+  }
+}
+
+static PointJob make_job(const Matrix& m, const PointArray& in, PointArray* out) {
+  PointJob job;
+  job.m = m.data;
+  job.project = false;
+  job.w = 1;
+  job.sx = job.sy = 0;
+  job.n = in.size();
+  job.in = &in;
+  job.out = out;
+  return job;
+}
+
+void transform_points(const Matrix& m, const PointArray& in, PointArray* out,
+                      ThreadPool* pool) {
+  PointJob job = make_job(m, in, out);
+  run(&job, pool);
+}
+
+void transform_vectors(const Matrix& m, const PointArray& in, PointArray* out,
+                       ThreadPool* pool) {
+  PointJob job = make_job(m, in, out);
+  job.w = 0;
+  run(&job, pool);
+}
+
+void project_points(const Matrix& mvp, unsigned width, unsigned height,
+                    const PointArray& in, PointArray* out, ThreadPool* pool) {
+  PointJob job = make_job(mvp, in, out);
+  job.project = true;
+  job.sx = width;
+  job.sy = height;
+  run(&job, pool);
+}
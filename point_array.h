@@ -0,0 +1,72 @@
+#ifndef POINT_ARRAY_H
+#define POINT_ARRAY_H
+
+#include "matrix.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+// points kept as separate x, y and z arrays so a batch of them can be
+// loaded straight into vector registers, unlike the 12 byte Points
+class PointArray {
+public:
+  std::vector<float> x, y, z;
+
+  inline PointArray() {
+  }
+
+  inline PointArray(const Points& points) {
+    resize(points.size());
+    for(unsigned ii = 0; ii < points.size(); ++ii) {
+      x[ii] = points[ii].x;
+      y[ii] = points[ii].y;
+      z[ii] = points[ii].z;
+    }
+  }
+
+  inline unsigned size() const {
+    return x.size();
+  }
+
+  inline void resize(unsigned n) {
+    x.resize(n);
+    y.resize(n);
+    z.resize(n);
+  }
+
+  inline void push_back(const Point& p) {
+    x.push_back(p.x);
+    y.push_back(p.y);
+    z.push_back(p.z);
+  }
+
+  inline Point operator[](unsigned ii) const {
+    return Point(x[ii], y[ii], z[ii]);
+  }
+
+  inline void to_points(Points* points) const {
+    points->resize(size());
+    for(unsigned ii = 0; ii < size(); ++ii) {
+      (*points)[ii] = (*this)[ii];
+    }
+  }
+};
+
+// batches at least this big are split across the pool when one is given
+const unsigned point_batch_threshold = 1 << 16;
+
+// out = m * in. in and out may be the same array. with a pool, big
+// batches are spread over its threads.
+void transform_points(const Matrix& m, const PointArray& in, PointArray* out,
+                      ThreadPool* pool = NULL);
+
+// like transform_points but ignoring m's translation, for directions
+void transform_vectors(const Matrix& m, const PointArray& in, PointArray* out,
+                       ThreadPool* pool = NULL);
+
+// window coordinates of in seen through mvp in a width by height
+// viewport, with the ndc depth in z. points behind the eye come out NaN.
+void project_points(const Matrix& mvp, unsigned width, unsigned height,
+                    const PointArray& in, PointArray* out, ThreadPool* pool = NULL);
+
+#endif
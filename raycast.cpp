@@ -0,0 +1,190 @@
+#include "raycast.h"
+#include "shading.h"
+#include "utils.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// skybox.vert draws its quad at this depth
+static const float sky_depth = 0.99f;
+
+// column major like Matrix::data
+static inline float m_elm(const float* m, unsigned r, unsigned c) {
+  return m[c*4+r];
+}
+
+// just the rotation part of m
+static Vector rotate(const Matrix& m, const Vector& v) {
+  return Vector(m.elm(0,0) * v.x + m.elm(0,1) * v.y + m.elm(0,2) * v.z,
+                m.elm(1,0) * v.x + m.elm(1,1) * v.y + m.elm(1,2) * v.z,
+                m.elm(2,0) * v.x + m.elm(2,1) * v.y + m.elm(2,2) * v.z);
+}
+
+RaycastRenderer::RaycastRenderer(ThreadPool* pool, Image* colors, Image* norm_spec,
+                                 Image* night_lights, Image* sky[6])
+  : pool(pool), colors(colors), norm_spec(norm_spec), night_lights(night_lights),
+    out(NULL), width(0), height(0), tiles_x(0), tiles_y(0) {
+  for(unsigned ii = 0; ii < 6; ++ii) {
+    this->sky[ii] = sky[ii];
+  }
+
+  // the pole of the ellipsoid the mesh is built from
+  polar_radius = Point::fromLatLon(M_PI/2, 0).z;
+}
+
+void RaycastRenderer::tile_job(void* ctx, unsigned index) {
+  RaycastRenderer* r = (RaycastRenderer*)ctx;
+  r->render_tile(index % r->tiles_x, index / r->tiles_x);
+}
+
+void RaycastRenderer::render_tile(unsigned tx, unsigned ty) {
+  const int x0 = tx * TILE_SIZE;
+  const int y0 = ty * TILE_SIZE;
+  const int x1 = std::min(x0 + TILE_SIZE, (int)width);
+  const int y1 = std::min(y0 + TILE_SIZE, (int)height);
+
+  // scaling z by 1/polar_radius turns the ellipsoid into the unit
+  // sphere. the ray origin's part of the quadratic is the same for all.
+  const float iz2 = 1.0f / (polar_radius * polar_radius);
+  const float c = eye.x*eye.x + eye.y*eye.y + eye.z*eye.z*iz2 - 1;
+
+  const float* st = sky_transform;
+  for(int py = y0; py < y1; ++py) {
+    unsigned char* row = out->data + (size_t)py * out->w * out->ch;
+    float ndc_y = (py + 0.5f) / height * 2 - 1;
+
+    f4 row_x = f4(ray_y.x * ndc_y + ray_z.x);
+    f4 row_y = f4(ray_y.y * ndc_y + ray_z.y);
+    f4 row_z = f4(ray_y.z * ndc_y + ray_z.z);
+
+    for(int px = x0; px < x1; px += 4) {
+      float nx[4];
+      for(int ll = 0; ll < 4; ++ll) {
+        nx[ll] = (px + ll + 0.5f) / width * 2 - 1;
+      }
+      f4 ndc_x = f4::load(nx);
+
+      f4 dx = ndc_x * ray_x.x + row_x;
+      f4 dy = ndc_x * ray_x.y + row_y;
+      f4 dz = ndc_x * ray_x.z + row_z;
+
+      // nearest root of a t^2 + 2 b t + c in front of the eye
+      f4 a = dx*dx + dy*dy + dz*dz * iz2;
+      f4 b = dx * eye.x + dy * eye.y + dz * (eye.z * iz2);
+      f4 disc = b*b - a * c;
+      f4 t = (-b - f4::sqrt(f4::max(disc, f4(0.0f)))) / a;
+      int hits = ((f4(0.0f) <= disc) & (f4(0.0f) < t)).movemask();
+
+      f4 result[3];
+      if(hits) {
+        f4 hx = dx * t + eye.x;
+        f4 hy = dy * t + eye.y;
+        f4 hz = dz * t + eye.z;
+
+        // the mesh's normals are its positions and its tangents are
+        // +z cross the unit normal, see main.cpp
+        f4 ilen = f4(1.0f) / f4::sqrt(hx*hx + hy*hy + hz*hz);
+        f4 tx_ = -hy * ilen;
+        f4 ty_ = hx * ilen;
+        f4 bx = -hz * ty_;
+        f4 by = hz * tx_;
+        f4 bz = hx * ty_ - hy * tx_;
+
+        // ads.vert works in camera space but the dot products are the
+        // same here since mv is rigid
+        f4 ex = f4(eye.x) - hx, ey = f4(eye.y) - hy, ez = f4(eye.z) - hz;
+        f4 elen = f4::sqrt(ex*ex + ey*ey + ez*ez);
+        ex = ex / elen; ey = ey / elen; ez = ez / elen;
+        f4 lx = f4(light.x) - hx, ly = f4(light.y) - hy, lz = f4(light.z) - hz;
+        f4 llen = f4::sqrt(lx*lx + ly*ly + lz*lz);
+        lx = lx / llen; ly = ly / llen; lz = lz / llen;
+
+        AdsFragments frag;
+        (tx_*ex + ty_*ey).store(frag.eye[0]);
+        (bx*ex + by*ey + bz*ez).store(frag.eye[1]);
+        (hx*ex + hy*ey + hz*ez).store(frag.eye[2]);
+        (tx_*lx + ty_*ly).store(frag.light[0]);
+        (bx*lx + by*ly + bz*lz).store(frag.light[1]);
+        (hx*lx + hy*ly + hz*lz).store(frag.light[2]);
+
+        float hit_x[4], hit_y[4], hit_z[4];
+        hx.store(hit_x);
+        hy.store(hit_y);
+        hz.store(hit_z);
+        for(int ll = 0; ll < 4; ++ll) {
+          if(!(hits & (1 << ll))) {
+            frag.clear(ll);
+            continue;
+          }
+
+          // invert fromLatLon and map to the mesh's texture coordinates
+          float s = std::min(std::max(hit_z[ll] / polar_radius, -1.0f), 1.0f);
+          float lat = asinf(s);
+          float lon = atan2f(hit_y[ll], hit_x[ll]);
+          float u = (lon + M_PI) / (2 * M_PI);
+          float v = 0.5f - lat / M_PI;
+          frag.fetch(ll, colors, norm_spec, night_lights, u, v);
+        }
+
+        shade_ads(frag, result);
+      }
+
+      float rgb[3][4];
+      for(unsigned cc = 0; cc < 3; ++cc) result[cc].store(rgb[cc]);
+
+      for(int ll = 0; ll < 4 && px + ll < x1; ++ll) {
+        unsigned char* dst = row + (px + ll) * out->ch;
+        if(hits & (1 << ll)) {
+          for(unsigned cc = 0; cc < 3; ++cc) dst[cc] = to_byte(rgb[cc][ll]);
+          continue;
+        }
+
+        // skybox.vert: mv * perspective_inv * vec4(vertex, 1), no divide
+        float dir[3], texel[4];
+        for(unsigned rr = 0; rr < 3; ++rr) {
+          dir[rr] = m_elm(st,rr,0) * nx[ll] + m_elm(st,rr,1) * ndc_y +
+            m_elm(st,rr,2) * sky_depth + m_elm(st,rr,3);
+        }
+        sample_cube(sky, dir[0], dir[1], dir[2], texel);
+        for(unsigned cc = 0; cc < 3; ++cc) dst[cc] = to_byte(texel[cc]);
+      }
+    }
+  }
+}
+
+void RaycastRenderer::render(Image* out, unsigned nrows,
+                             const Matrix& mv, const Matrix& /*perspective*/,
+                             const Vector& light, const Matrix& sky_mv,
+                             const Matrix& perspective_inv) {
+  if(out->ch != 3) fail_exit("raycast renderer writes 3 channel images");
+
+  this->out = out;
+  width = out->w;
+  height = nrows;
+
+  // everything is cast in globe space
+  Matrix mv_copy(mv);
+  Matrix to_globe = mv_copy.invertspecial();
+  eye = to_globe * Vector(0, 0, 0);
+  this->light = to_globe * light;
+
+  // the camera space point on the near plane under ndc (x, y) is
+  // perspective_inv * (x, y, -1, 1). its w is the same everywhere so
+  // only the sign matters for a direction.
+  const Matrix& pi = perspective_inv;
+  float sign = pi.elm(3,3) - pi.elm(3,2) < 0 ? -1.0f : 1.0f;
+  ray_x = rotate(to_globe, Vector(pi.elm(0,0), pi.elm(1,0), pi.elm(2,0)) * sign);
+  ray_y = rotate(to_globe, Vector(pi.elm(0,1), pi.elm(1,1), pi.elm(2,1)) * sign);
+  ray_z = rotate(to_globe, Vector(pi.elm(0,3) - pi.elm(0,2),
+                                  pi.elm(1,3) - pi.elm(1,2),
+                                  pi.elm(2,3) - pi.elm(2,2)) * sign);
+
+  Matrix sky_mv_copy(sky_mv);
+  Matrix sky = sky_mv_copy * perspective_inv;
+  memcpy(sky_transform, sky.data, sizeof(sky_transform));
+
+  tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+  tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+  pool->parallel_for(tiles_x * tiles_y, tile_job, this);
+}
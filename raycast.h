@@ -0,0 +1,48 @@
+#ifndef RAYCAST_H
+#define RAYCAST_H
+
+#include "software.h"
+
+// draws the globe by intersecting every pixel's ray with the ellipsoid
+// Point::fromLatLon describes instead of rasterizing the mesh, so the
+// silhouette is exact and there is no per triangle cost. tiles are cast
+// in parallel, four rays at a time.
+class RaycastRenderer : public CpuRenderer {
+public:
+  // sky holds the cube faces in CubeMap::from_files order
+  RaycastRenderer(ThreadPool* pool, Image* colors, Image* norm_spec,
+                  Image* night_lights, Image* sky[6]);
+
+  // mv must be rigid, which every camera and globe transform we build is
+  void render(Image* out, unsigned nrows,
+              const Matrix& mv, const Matrix& perspective, const Vector& light,
+              const Matrix& sky_mv, const Matrix& perspective_inv);
+
+  enum {
+    TILE_SIZE = 64
+  };
+
+private:
+  static void tile_job(void* ctx, unsigned index);
+  void render_tile(unsigned tx, unsigned ty);
+
+  ThreadPool* pool;
+  Image* colors;
+  Image* norm_spec;
+  Image* night_lights;
+  Image* sky[6];
+
+  // z radius of the ellipsoid, x and y are 1
+  float polar_radius;
+
+  // per render state, in globe space. the ray through ndc (x, y) runs
+  // from eye along ray_x * x + ray_y * y + ray_z.
+  Image* out;
+  unsigned width, height;
+  unsigned tiles_x, tiles_y;
+  Vector eye, light;
+  Vector ray_x, ray_y, ray_z;
+  float sky_transform[16];
+};
+
+#endif
@@ -1,11 +1,22 @@
 #include "shaders.h"
+#include "file_watch.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <set>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 char* shader_buffer = NULL;
 
+// compiles in the background where the driver can, the status is only
+// looked at once the program it goes into is finished
 int renderer_load_shader(const char* src, GLenum kind) {
   int shader = glCreateShader(kind);
   gl_check_("glCreateShader");
@@ -27,28 +38,253 @@ int renderer_load_shader(const char* src, GLenum kind) {
   glCompileShader(shader);
   gl_check_("glCompileShader");
 
+  return shader;
+}
+
+// empty if shader compiled
+static std::string compile_error(int shader, const char* name) {
   int status;
   glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+  if(status != GL_FALSE) return std::string();
+
+  char buffer[1024];
+  int length;
+  glGetShaderInfoLog(shader, sizeof(buffer), &length, buffer);
+  return stdstring("glCompileShader: %s, %s", buffer, name);
+}
 
-  if(status == GL_FALSE) {
-    char buffer[1024];
-    int length;
-    glGetShaderInfoLog(shader, sizeof(buffer), &length, buffer);
-    fail_exit("glCompileShader: %s, %s\n", buffer, src);
+// a broken program is the end of us, unless it's a reload where the
+// old one can stay
+static bool program_error(bool fatal, const std::string& error) {
+  if(fatal) fail_exit("%s", error.c_str());
+  LOGW("%s", error.c_str());
+  return false;
+}
+
+// with KHR_parallel_shader_compile programs can be asked whether
+// they're done without waiting for them
+static bool parallel_compile() {
+  static int supported = -1;
+  if(supported == -1) {
+    supported = 0;
+#ifdef GL_COMPLETION_STATUS_KHR
+    if(gl_has_extension("GL_KHR_parallel_shader_compile")) {
+      // as many threads as the driver sees fit
+#ifdef BUILD_SDL
+      glMaxShaderCompilerThreadsKHR(0xffffffff);
+#else
+      // extension entry points aren't exported by the EGL libraries
+      typedef void (*MaxThreadsProc)(GLuint count);
+      MaxThreadsProc max_threads =
+        (MaxThreadsProc)eglGetProcAddress("glMaxShaderCompilerThreadsKHR");
+      if(max_threads) max_threads(0xffffffff);
+#endif
+      supported = 1;
+    }
+#endif
+    LOGI("parallel shader compile: %s", supported ? "yes" : "no");
   }
+  return supported;
+}
 
-  return shader;
+// what a program still needs once its link completes. the names come
+// from the loader's string literals.
+struct Program::Pending {
+  const char* vertexname;
+  const char* fragmentname;
+  int vertex;
+  int fragment;
+  std::string cache_path;
+  const char* uniform_bindings[UNIFORM_MAX];
+  const char* block_bindings[BLOCK_MAX];
+  long submitted;
+};
+
+// set while reload_programs rebuilds a program, when a missing file
+// (say, halfway through an editor's save) isn't fatal
+static bool shader_reloading = false;
+
+// GLSL has no include of its own, so lines of the form
+// #include "file" are replaced with that file's source. the path of
+// every file read is added to files.
+std::string shader_slurp(const char* fname, std::vector<std::string>* files) {
+  std::string path = filename_resolve(fname);
+  if(files) files->push_back(path);
+  if(shader_reloading && access(path.c_str(), R_OK) != 0) {
+    LOGW("can't read %s: %s", path.c_str(), strerror(errno));
+    return std::string();
+  }
+
+  char* src = filename_slurp(fname);
+  std::string result;
+
+  const char* line = src;
+  while(*line) {
+    const char* eol = strchr(line, '\n');
+    size_t len = eol ? eol - line + 1 : strlen(line);
+    std::string text(line, len);
+
+    char included[256];
+    if(sscanf(text.c_str(), " #include \"%255[^\"]\"", included) == 1) {
+      result += shader_slurp(included, files);
+      result += "\n";
+    } else {
+      result += text;
+    }
+    line += len;
+  }
+
+  free(src);
+  return result;
+}
+
+// linked programs are cached as driver binaries so later runs skip the
+// compile and link. SHADER_CACHE names the directory, empty turns the
+// cache off, and it defaults to ~/.cache/earth/shaders. a binary the
+// driver turns down (new driver, different GPU) just means we compile
+// from source again and overwrite it.
+#define PROGRAM_CACHE_MAGIC 0x50424531 /* PBE1 */
+
+struct ProgramCacheHeader {
+  unsigned magic;
+  unsigned format;
+  unsigned length;
+};
+
+static bool program_cache_dir(std::string* dir) {
+  static std::string cache_dir;
+  static int state = -1;
+
+  if(state == -1) {
+    state = 0;
+    const char* env = getenv("SHADER_CACHE");
+    const char* home = getenv("HOME");
+    if(env) {
+      cache_dir = env;
+    } else if(home) {
+      cache_dir = stdstring("%s/.cache/earth/shaders", home);
+    }
+
+    GLint nformats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &nformats);
+    // drivers without the extension raise an error here, don't let a
+    // later gl_check take the blame
+    while(glGetError() != GL_NO_ERROR);
+
+    if(cache_dir.empty() || nformats <= 0) return false;
+
+    // make each missing component of the path in turn
+    for(size_t slash = cache_dir.find('/', 1); ; slash = cache_dir.find('/', slash + 1)) {
+      std::string part = cache_dir.substr(0, slash);
+      if(mkdir(part.c_str(), 0755) != 0 && errno != EEXIST) {
+        LOGW("shader cache disabled, can't create %s: %s", part.c_str(), strerror(errno));
+        return false;
+      }
+      if(slash == std::string::npos) break;
+    }
+    state = 1;
+  }
+
+  *dir = cache_dir;
+  return state == 1;
+}
+
+// 64 bit FNV-1a
+static unsigned long long program_cache_hash(const std::string& key) {
+  unsigned long long hash = 14695981039346656037ULL;
+  for(size_t ii = 0; ii < key.size(); ++ii) {
+    hash ^= (unsigned char)key[ii];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static std::string program_cache_path(const std::string& key) {
+  std::string dir;
+  if(!program_cache_dir(&dir)) return std::string();
+  return stdstring("%s/%016llx.bin", dir.c_str(), program_cache_hash(key));
+}
+
+// true if program is now linked from the cached binary
+static bool program_cache_load(GLuint program, const std::string& path) {
+  FILE* f = fopen(path.c_str(), "rb");
+  if(!f) return false;
+
+  ProgramCacheHeader header;
+  std::string binary;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == PROGRAM_CACHE_MAGIC;
+  if(ok) {
+    binary.resize(header.length);
+    ok = header.length > 0 && fread(&binary[0], 1, header.length, f) == header.length;
+  }
+  fclose(f);
+  if(!ok) {
+    LOGW("ignoring malformed shader cache entry %s", path.c_str());
+    return false;
+  }
+
+  glProgramBinary(program, header.format, binary.data(), header.length);
+  while(glGetError() != GL_NO_ERROR);
+
+  int link_status;
+  glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+  if(link_status == GL_FALSE) {
+    LOGI("shader cache entry %s was rejected, recompiling", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void program_cache_store(GLuint program, const std::string& path) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+  if(length <= 0) return;
+
+  ProgramCacheHeader header;
+  std::string binary(length, '\0');
+  GLenum format;
+  GLsizei written = 0;
+  glGetProgramBinary(program, length, &written, &format, &binary[0]);
+  if(glGetError() != GL_NO_ERROR || written <= 0) return;
+
+  header.magic = PROGRAM_CACHE_MAGIC;
+  header.format = format;
+  header.length = written;
+
+  // written under a temporary name and renamed so a concurrent worker
+  // never reads half a binary
+  std::string tmp = stdstring("%s.%d", path.c_str(), (int)getpid());
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if(!f) return;
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+    fwrite(binary.data(), 1, written, f) == (size_t)written;
+  ok = fclose(f) == 0 && ok;
+  if(!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    LOGW("couldn't write shader cache entry %s", path.c_str());
+    remove(tmp.c_str());
+  }
 }
 
 Program::Program() {
   program = -1;
   for(int ii = 0; ii < UNIFORM_MAX; ++ii) {
     uniforms[ii] = -1;
+    uniform_shadow[ii].size = 0;
+  }
+  for(int ii = 0; ii < BLOCK_MAX; ++ii) {
+    blocks[ii] = -1;
   }
+  pending = NULL;
 }
 
 Program::~Program() {
+  if(pending) {
+    if(pending->vertex) glDeleteShader(pending->vertex);
+    if(pending->fragment) glDeleteShader(pending->fragment);
+    delete pending;
+  }
   if(program != -1) {
+    gl_state.deleted_program(program);
     glDeleteProgram(program);
   }
 }
@@ -61,45 +297,94 @@ GLuint Program::requireUniform(ProgramUniforms uniform) {
 }
 
 void Program::use() {
-  if(program != current_program) {
-    glUseProgram(program);
-    current_program = program;
-  }
+  finish();
+  gl_state.use_program(program);
 }
 
-Program* Program::create(const char* vertexname, const char* fragmentname, ...) {
-  char* vertex_source = filename_slurp(vertexname);
-  char* fragment_source = filename_slurp(fragmentname);
+// records value as the uniform's latest and counts the call either way
+bool Program::uniform_changed(ProgramUniforms uni, const void* value, unsigned size) {
+  UniformShadow& shadow = uniform_shadow[uni];
+  bool changed = shadow.size != size || memcmp(shadow.value, value, size) != 0;
+  gl_state.count(STATE_CALL_UNIFORM, changed);
+  if(changed) {
+    memcpy(shadow.value, value, size);
+    shadow.size = size;
+  }
+  return changed;
+}
 
-  LOGI("renderer_load_shader: %s", vertexname);
-  int vertex = renderer_load_shader(vertex_source, GL_VERTEX_SHADER);
-  LOGI("renderer_load_shader: %s", fragmentname);
-  int fragment = renderer_load_shader(fragment_source, GL_FRAGMENT_SHADER);
-  free(vertex_source);
-  free(fragment_source);
+bool uniform_blocks_supported() {
+  // shaders are #version 120 so they need the extension by name
+  static int supported = -1;
+  if(supported == -1) {
+#ifdef GL_UNIFORM_BUFFER
+    supported = gl_has_extension("GL_ARB_uniform_buffer_object");
+#else
+    supported = 0;
+#endif
+  }
+  return supported;
+}
 
-  // uniform bindings are deferred until the program is linked
-  const char* uniform_bindings[UNIFORM_MAX];
-  memset(uniform_bindings, 0, sizeof(uniform_bindings));
+Program* Program::create(const char* vertexname, const char* fragmentname, ...) {
+  va_list ap;
+  va_start(ap, fragmentname);
+  Program* p = create_v(NULL, vertexname, fragmentname, ap);
+  va_end(ap);
+  return p;
+}
 
-  int program = glCreateProgram();
-  Program* p = new Program();
-  p->program = program;
+Program* Program::create_variant(const char* defines, const char* vertexname,
+                                 const char* fragmentname, ...) {
+  va_list ap;
+  va_start(ap, fragmentname);
+  Program* p = create_v(defines, vertexname, fragmentname, ap);
+  va_end(ap);
+  return p;
+}
 
-  gl_check(glAttachShader(program, vertex));
-  gl_check(glAttachShader(program, fragment));
+Program* Program::create_v(const char* defines, const char* vertexname,
+                           const char* fragmentname, va_list ap) {
+  TRACE_ZONE("submit program");
+  // renderer_load_shader puts the #version line in front of these
+  std::string prelude;
+  if(uniform_blocks_supported()) {
+    prelude += "#extension GL_ARB_uniform_buffer_object : require\n";
+    prelude += "#define UNIFORM_BLOCKS 1\n";
+  }
+  char name[128];
+  int used;
+  for(const char* d = defines; d && sscanf(d, " %127s%n", name, &used) == 1; d += used) {
+    prelude += stdstring("#define %s 1\n", name);
+  }
+  std::vector<std::string> sources;
+  std::string vertex_source = prelude + shader_slurp(vertexname, &sources);
+  std::string fragment_source = prelude + shader_slurp(fragmentname, &sources);
+
+  // bindings are gathered up front since attribute locations are baked
+  // into the linked binary and have to be part of its cache key.
+  // uniform and block lookups wait until the program is finished.
+  Pending* pending = new Pending();
+  pending->vertexname = vertexname;
+  pending->fragmentname = fragmentname;
+  pending->vertex = pending->fragment = 0;
+  pending->submitted = abs_utime();
+  const char* attribute_bindings[ATTRIBUTE_MAX];
+  const char** uniform_bindings = pending->uniform_bindings;
+  const char** block_bindings = pending->block_bindings;
+  memset(attribute_bindings, 0, sizeof(attribute_bindings));
+  memset(pending->uniform_bindings, 0, sizeof(pending->uniform_bindings));
+  memset(pending->block_bindings, 0, sizeof(pending->block_bindings));
 
   int mode = BINDING_INVALID;
 
-  va_list ap;
-  va_start(ap, fragmentname);
   while(1) {
     unsigned arg = va_arg(ap, int);
     // are we done?
     if(arg == BINDING_DONE) break;
 
     // if mode switch, do it now
-    if(arg == BINDING_ATTRIBUTES || arg == BINDING_UNIFORMS) {
+    if(arg == BINDING_ATTRIBUTES || arg == BINDING_UNIFORMS || arg == BINDING_BLOCKS) {
       mode = arg;
       continue;
     }
@@ -111,51 +396,175 @@ Program* Program::create(const char* vertexname, const char* fragmentname, ...)
 
     if(mode == BINDING_ATTRIBUTES) {
       ProgramParameters param = (ProgramParameters)arg;
-      const char* name = va_arg(ap, char*);
-      gl_check(glBindAttribLocation(program, param, name));
+      attribute_bindings[param] = va_arg(ap, char*);
     } else if(mode == BINDING_UNIFORMS) {
       ProgramUniforms uniform = (ProgramUniforms)arg;
-      const char* name = va_arg(ap, char*);
-      uniform_bindings[uniform] = name;
+      uniform_bindings[uniform] = va_arg(ap, char*);
+    } else if(mode == BINDING_BLOCKS) {
+      ProgramBlocks block = (ProgramBlocks)arg;
+      block_bindings[block] = va_arg(ap, char*);
+    }
+  }
+
+  parallel_compile();
+  int program = glCreateProgram();
+  Program* p = new Program();
+  p->program = program;
+  p->pending = pending;
+  p->sources = sources;
+
+  // the key is everything that goes into the binary: the driver that
+  // built it, both sources and the binding table
+  std::string key = stdstring("%s\n%s\n%s\n", (const char*)glGetString(GL_VENDOR),
+                              (const char*)glGetString(GL_RENDERER),
+                              (const char*)glGetString(GL_VERSION));
+  key += vertex_source;
+  key += '\0';
+  key += fragment_source;
+  key += '\0';
+  for(unsigned attr = 0; attr < ATTRIBUTE_MAX; ++attr) {
+    if(attribute_bindings[attr]) key += stdstring("a%u=%s;", attr, attribute_bindings[attr]);
+  }
+  for(unsigned uniform = 0; uniform < UNIFORM_MAX; ++uniform) {
+    if(uniform_bindings[uniform]) key += stdstring("u%u=%s;", uniform, uniform_bindings[uniform]);
+  }
+  std::string cache_path = program_cache_path(key);
+  pending->cache_path = cache_path;
+  if(defines && *defines) {
+    LOGI("shader variant: %s", defines);
+  }
+
+  if(!cache_path.empty() && program_cache_load(program, cache_path)) {
+    LOGI("renderer_load_shader: %s, %s from cache", vertexname, fragmentname);
+  } else {
+    LOGI("renderer_load_shader: %s", vertexname);
+    int vertex = renderer_load_shader(vertex_source.c_str(), GL_VERTEX_SHADER);
+    LOGI("renderer_load_shader: %s", fragmentname);
+    int fragment = renderer_load_shader(fragment_source.c_str(), GL_FRAGMENT_SHADER);
+
+    gl_check(glAttachShader(program, vertex));
+    gl_check(glAttachShader(program, fragment));
+
+    for(unsigned attr = 0; attr < ATTRIBUTE_MAX; ++attr) {
+      if(!attribute_bindings[attr]) continue;
+      gl_check(glBindAttribLocation(program, attr, attribute_bindings[attr]));
+    }
+
+#ifdef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    if(!cache_path.empty()) {
+      gl_check(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
     }
+#endif
+
+    gl_check(glLinkProgram(program));
+    pending->vertex = vertex;
+    pending->fragment = fragment;
   }
 
-  gl_check(glLinkProgram(program));
+  return p;
+}
 
-  gl_check(glDeleteShader(vertex));
-  gl_check(glDeleteShader(fragment));
+bool Program::ready() {
+  if(!pending) return true;
+#ifdef GL_COMPLETION_STATUS_KHR
+  if(parallel_compile()) {
+    GLint done = GL_FALSE;
+    glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+    return done == GL_TRUE;
+  }
+#endif
+  // no way to ask without waiting
+  return false;
+}
+
+bool Program::finish(bool fatal) {
+  if(!pending) return true;
+  TRACE_ZONE("finish program");
+  Pending* p = pending;
+  pending = NULL;
+
+  // this is where we wait if the link isn't done
   int link_status;
   glGetProgramiv(program, GL_LINK_STATUS, &link_status);
+  std::string error;
   if(link_status == GL_FALSE) {
-    char buffer[1024];
-    int length;
-    glGetProgramInfoLog(program, sizeof(buffer), &length, buffer);
-    fail_exit("glLinkProgram: %s\n", buffer);
+    if(p->vertex) error = compile_error(p->vertex, p->vertexname);
+    if(p->fragment && error.empty()) error = compile_error(p->fragment, p->fragmentname);
+    if(error.empty()) {
+      char buffer[1024];
+      int length;
+      glGetProgramInfoLog(program, sizeof(buffer), &length, buffer);
+      error = stdstring("glLinkProgram: %s", buffer);
+    }
+  } else {
+    LOGI("program %s, %s finished %.1f ms after submission", p->vertexname, p->fragmentname,
+         (abs_utime() - p->submitted) / 1000.0);
+  }
+
+  if(p->vertex) {
+    gl_check(glDeleteShader(p->vertex));
+    gl_check(glDeleteShader(p->fragment));
+    if(error.empty() && !p->cache_path.empty()) program_cache_store(program, p->cache_path);
+  }
+  if(!error.empty()) {
+    delete p;
+    return program_error(fatal, error);
+  }
+
+  // blocks are attached to their binding points, which isn't part of
+  // a program binary
+  bool use_blocks = false;
+#ifdef GL_UNIFORM_BUFFER
+  use_blocks = uniform_blocks_supported();
+  for(unsigned block = 0; use_blocks && block < BLOCK_MAX; ++block) {
+    if(!p->block_bindings[block]) continue;
+    const char* name = p->block_bindings[block];
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if(index == GL_INVALID_INDEX) {
+      delete p;
+      return program_error(fatal, stdstring("glGetUniformBlockIndex: %s is not an active block",
+                                            name));
+    }
+    gl_check(glUniformBlockBinding(program, index, block));
+    blocks[block] = index;
   }
+#endif
 
   // now bind the uniforms
   for(unsigned uniform = 0; uniform < UNIFORM_MAX; ++uniform) {
-    if(!uniform_bindings[uniform]) continue;
-    const char* name = uniform_bindings[uniform];
+    if(!p->uniform_bindings[uniform]) continue;
+    const char* name = p->uniform_bindings[uniform];
     GLint loc = glGetUniformLocation(program, name);
+#ifdef GL_UNIFORM_BUFFER
+    if(loc < 0 && use_blocks) {
+      // block members have no location of their own
+      GLuint index;
+      glGetUniformIndices(program, 1, &name, &index);
+      if(index != GL_INVALID_INDEX) continue;
+    }
+#endif
     if(loc < 0) {
-      fail_exit("glGetUniformLocation: %s error %d", name, loc);
+      delete p;
+      return program_error(fatal, stdstring("glGetUniformLocation: %s error %d", name, loc));
     }
-    p->uniforms[uniform] = loc;
+    uniforms[uniform] = loc;
   }
 
-  return p;
+  delete p;
+  return true;
 }
 
 void Program::bind_attribute_buffer(ProgramParameters attr, unsigned element_length, GLuint buffer) {
-  gl_check(glBindBuffer(GL_ARRAY_BUFFER, buffer));
-  gl_check(glEnableVertexAttribArray(attr));
-  gl_check(glVertexAttribPointer(attr, element_length, GL_FLOAT, GL_FALSE, 0, 0));
+  gl_state.enable_attribute(attr);
+  gl_state.attribute_pointer(attr, element_length, GL_FLOAT, buffer);
 }
 
 void Program::bind_uniform(Texture* tex, unsigned slot, ProgramUniforms uni) {
   tex->bind(slot);
-  gl_check(glUniform1i(requireUniform(uni), slot));
+  GLint unit = slot;
+  if(uniform_changed(uni, &unit, sizeof(unit))) {
+    gl_check(glUniform1i(requireUniform(uni), unit));
+  }
 }
 
 void Program::bind_uniform(Texture* tex, ProgramUniforms uni) {
@@ -165,7 +574,10 @@ void Program::bind_uniform(Texture* tex, ProgramUniforms uni) {
 
 void Program::bind_uniform(CubeMap* tex, unsigned slot, ProgramUniforms uni) {
   tex->bind(slot);
-  gl_check(glUniform1i(requireUniform(uni), slot));
+  GLint unit = slot;
+  if(uniform_changed(uni, &unit, sizeof(unit))) {
+    gl_check(glUniform1i(requireUniform(uni), unit));
+  }
 }
 
 void Program::bind_uniform(CubeMap* tex, ProgramUniforms uni) {
@@ -174,23 +586,127 @@ void Program::bind_uniform(CubeMap* tex, ProgramUniforms uni) {
 }
 
 void Program::bind_uniform(const Vector& v, ProgramUniforms uni) {
-  gl_check(glUniform3fv(requireUniform(uni), 1, (const float*)&v));
+  if(uniform_changed(uni, &v, sizeof(float) * 3)) {
+    gl_check(glUniform3fv(requireUniform(uni), 1, (const float*)&v));
+  }
 }
 
 void Program::bind_uniform(const Matrix& m, ProgramUniforms uni) {
-  gl_check(glUniformMatrix4fv(requireUniform(uni), 1, GL_FALSE, m.data));
+  if(uniform_changed(uni, m.data, sizeof(m.data))) {
+    gl_check(glUniformMatrix4fv(requireUniform(uni), 1, GL_FALSE, m.data));
+  }
 }
 
-GLuint Program::current_program = 0;
+void Program::bind_uniform(float f, ProgramUniforms uni) {
+  if(uniform_changed(uni, &f, sizeof(f))) {
+    gl_check(glUniform1f(requireUniform(uni), f));
+  }
+}
 
 LoaderToProgram programs;
-Program* get_program(ProgramLoader loader) {
-  LoaderToProgram::iterator iter = programs.find(loader);
-  if(iter == programs.end()) {
-    Program* program = loader();
-    programs.insert(std::make_pair(loader, program));
-    return program;
-  } else {
-    return iter->second;
+
+// replacements for programs whose sources changed, while they build
+static LoaderToProgram reloads;
+static FileWatcher* program_watcher = NULL;
+
+static void watch_sources(Program* program) {
+  if(!program_watcher) return;
+  for(size_t ii = 0; ii < program->sources.size(); ++ii) {
+    program_watcher->watch(program->sources[ii]);
+  }
+}
+
+static Program* find_program(ProgramLoader loader, unsigned variant) {
+  std::pair<ProgramLoader, unsigned> key(loader, variant);
+  LoaderToProgram::iterator iter = programs.find(key);
+  if(iter != programs.end()) return iter->second;
+
+  Program* program = loader(variant);
+  programs.insert(std::make_pair(key, program));
+  watch_sources(program);
+  return program;
+}
+
+void prepare_program(ProgramLoader loader, unsigned variant) {
+  find_program(loader, variant);
+}
+
+void poll_programs() {
+  for(LoaderToProgram::iterator iter = programs.begin(); iter != programs.end(); ++iter) {
+    if(iter->second->ready()) iter->second->finish();
+  }
+}
+
+Program* get_program(ProgramLoader loader, unsigned variant) {
+  Program* program = find_program(loader, variant);
+  program->finish();
+  return program;
+}
+
+void watch_programs() {
+  if(program_watcher) return;
+  program_watcher = new FileWatcher();
+  if(!program_watcher->active()) return;
+
+  for(LoaderToProgram::iterator iter = programs.begin(); iter != programs.end(); ++iter) {
+    watch_sources(iter->second);
+  }
+  LOGI("watching shader sources for changes");
+}
+
+static bool uses_any(Program* program, const std::set<std::string>& changed) {
+  for(size_t ii = 0; ii < program->sources.size(); ++ii) {
+    if(changed.count(program->sources[ii])) return true;
+  }
+  return false;
+}
+
+void reload_programs() {
+  if(!program_watcher) return;
+  TRACE_ZONE("reload programs");
+
+  std::set<std::string> changed;
+  program_watcher->changed(&changed);
+
+  // anything already rebuilding is out of date again, start over
+  for(LoaderToProgram::iterator iter = programs.begin();
+      !changed.empty() && iter != programs.end(); ++iter) {
+    if(!uses_any(iter->second, changed)) continue;
+
+    LoaderToProgram::iterator old = reloads.find(iter->first);
+    if(old != reloads.end()) {
+      delete old->second;
+      reloads.erase(old);
+    }
+
+    LOGI("shader sources changed, rebuilding %s",
+         iter->second->sources.empty() ? "program" : iter->second->sources[0].c_str());
+    shader_reloading = true;
+    Program* program = iter->first.first(iter->first.second);
+    shader_reloading = false;
+    reloads.insert(std::make_pair(iter->first, program));
+  }
+
+  // without KHR_parallel_shader_compile there's no telling whether a
+  // rebuild is done, so it's waited on right away
+  LoaderToProgram::iterator iter = reloads.begin();
+  while(iter != reloads.end()) {
+    Program* program = iter->second;
+    if(!program->ready() && parallel_compile()) {
+      ++iter;
+      continue;
+    }
+
+    LoaderToProgram::iterator current = programs.find(iter->first);
+    if(program->finish(false)) {
+      delete current->second;
+      current->second = program;
+      watch_sources(program);
+      LOGI("shader reload succeeded");
+    } else {
+      delete program;
+      LOGW("shader reload failed, keeping the previous program");
+    }
+    reloads.erase(iter++);
   }
 }
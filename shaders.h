@@ -4,14 +4,19 @@
 #include "gl_headers.h"
 #include "image.h"
 #include "matrix.h"
+#include "gl_state.h"
 
 #include <map>
+#include <string>
+#include <vector>
+#include <stdarg.h>
 
 
 #define BINDING_ATTRIBUTES (int)-1
 #define BINDING_UNIFORMS (int)-2
 #define BINDING_DONE (int)-3
 #define BINDING_INVALID (int)-4
+#define BINDING_BLOCKS (int)-5
 
 typedef enum {
   ATTRIBUTE_VERTEX,
@@ -46,17 +51,65 @@ typedef enum {
   UNIFORM_SCALE,
   UNIFORM_TEX_BL,
   UNIFORM_TEX_TR,
+  UNIFORM_PERSPECTIVE_INV,
+  UNIFORM_TIME,
   UNIFORM_MAX
 } ProgramUniforms;
 
+// uniform blocks and the binding points they're attached to. only
+// used when uniform_blocks_supported(), otherwise their members are
+// ordinary uniforms and are bound under BINDING_UNIFORMS like any
+// other.
+typedef enum {
+  BLOCK_FRAME,
+  BLOCK_OBJECT,
+  BLOCK_MAX
+} ProgramBlocks;
+
+// true when the current context has uniform buffers. programs are then
+// built with UNIFORM_BLOCKS defined.
+bool uniform_blocks_supported();
+
 class Program {
   Program();
 
+  // the last value sent to each uniform, so resending it can be skipped
+  struct UniformShadow {
+    unsigned size; // bytes of value in use, 0 until the first send
+    unsigned char value[sizeof(float) * 16];
+  };
+  UniformShadow uniform_shadow[UNIFORM_MAX];
+
+  bool uniform_changed(ProgramUniforms uni, const void* value, unsigned size);
+
+  static Program* create_v(const char* defines, const char* vname, const char* fname,
+                           va_list ap);
+
+  // set while the program is still compiling
+  struct Pending;
+  Pending* pending;
+
  public:
   static Program* create(const char* vname, const char* fname, ...);
 
+  // the same with each of the space separated names in defines set to
+  // 1 in both shaders, to build one variant of a shader with optional
+  // features. bindings with a NULL name are skipped, for the ones a
+  // variant leaves out.
+  static Program* create_variant(const char* defines, const char* vname,
+                                 const char* fname, ...);
+
   ~Program();
 
+  // the program create hands back may still be compiling and linking.
+  // ready polls without blocking, where the driver can tell, and finish
+  // waits for it and looks up the bindings. use finishes first.
+  //
+  // a program that fails to build is fatal, unless fatal is false when
+  // the error is logged and finish returns false.
+  bool ready();
+  bool finish(bool fatal = true);
+
   GLuint requireUniform(ProgramUniforms uniform);
 
   void use();
@@ -68,16 +121,42 @@ class Program {
   void bind_uniform(CubeMap* tex, ProgramUniforms uni);
   void bind_uniform(const Vector& v, ProgramUniforms uni);
   void bind_uniform(const Matrix& m, ProgramUniforms uni);
+  void bind_uniform(float f, ProgramUniforms uni);
+
+  // true if uni is a plain uniform in this program, block members
+  // aren't
+  bool has_uniform(ProgramUniforms uni) const { return uniforms[uni] != (GLuint)-1; }
 
   GLuint uniforms[UNIFORM_MAX];
+  GLuint blocks[BLOCK_MAX];
   GLuint program;
 
-  static GLuint current_program;
+  // every file the shaders were read from, includes and all
+  std::vector<std::string> sources;
 };
 
-typedef Program* (*ProgramLoader)(void);
-typedef std::map<ProgramLoader, Program*> LoaderToProgram;
+// loaders get the variant asked for and build the program for it,
+// each loader is called once per variant
+typedef Program* (*ProgramLoader)(unsigned variant);
+typedef std::map<std::pair<ProgramLoader, unsigned>, Program*> LoaderToProgram;
+
+// start building a program without waiting on it, so several can
+// compile at once and alongside other loading
+void prepare_program(ProgramLoader loader, unsigned variant = 0);
+
+// finish the prepared programs that are done, without blocking
+void poll_programs();
+
+// the finished program, waiting on it if it isn't yet
+Program* get_program(ProgramLoader loader, unsigned variant = 0);
+
+// watch the source files of every program, now and later, for changes
+void watch_programs();
 
-Program* get_program(ProgramLoader loader);
+// rebuild the programs whose sources have changed since the last call.
+// a rebuild that compiles replaces the program in get_program's map,
+// one that doesn't is logged and the old program stays. returns at
+// once, rebuilds that aren't done are picked up on a later call.
+void reload_programs();
 
 #endif
@@ -0,0 +1,152 @@
+#include "shading.h"
+
+#include <math.h>
+#include <algorithm>
+
+// the constants in ads.frag
+static const float ambient = 0.1f;
+static const float shininess = 100.0f;
+static const float specular_intensity = 0.4f;
+static const float spec_color[3] = {1.0f, 1.0f, 0.8f};
+
+void sample(const Image* im, float s, float t, float* rgba) {
+  float u = s * im->w - 0.5f;
+  float v = t * im->h - 0.5f;
+  float fu = floorf(u);
+  float fv = floorf(v);
+  float a = u - fu;
+  float b = v - fv;
+
+  int x0 = (int)fu;
+  int y0 = (int)fv;
+  int x1 = std::min(std::max(x0 + 1, 0), im->w - 1);
+  int y1 = std::min(std::max(y0 + 1, 0), im->h - 1);
+  x0 = std::min(std::max(x0, 0), im->w - 1);
+  y0 = std::min(std::max(y0, 0), im->h - 1);
+
+  const unsigned char* p00 = im->data + (y0 * im->w + x0) * im->ch;
+  const unsigned char* p10 = im->data + (y0 * im->w + x1) * im->ch;
+  const unsigned char* p01 = im->data + (y1 * im->w + x0) * im->ch;
+  const unsigned char* p11 = im->data + (y1 * im->w + x1) * im->ch;
+
+  float w00 = (1 - a) * (1 - b);
+  float w10 = a * (1 - b);
+  float w01 = (1 - a) * b;
+  float w11 = a * b;
+
+  const float scale = 1.0f / 255.0f;
+  for(int c = 0; c < 4; ++c) {
+    if(c >= im->ch) {
+      rgba[c] = 1.0f;
+      continue;
+    }
+    rgba[c] = (w00 * p00[c] + w10 * p10[c] + w01 * p01[c] + w11 * p11[c]) * scale;
+  }
+}
+
+// face selection from the GL spec's cube map table
+void sample_cube(Image* const* faces, float rx, float ry, float rz, float* rgba) {
+  float ax = fabsf(rx), ay = fabsf(ry), az = fabsf(rz);
+  int face;
+  float sc, tc, ma;
+
+  if(ax >= ay && ax >= az) {
+    face = rx >= 0 ? 0 : 1;
+    sc = rx >= 0 ? -rz : rz;
+    tc = -ry;
+    ma = ax;
+  } else if(ay >= az) {
+    face = ry >= 0 ? 2 : 3;
+    sc = rx;
+    tc = ry >= 0 ? rz : -rz;
+    ma = ay;
+  } else {
+    face = rz >= 0 ? 4 : 5;
+    sc = rz >= 0 ? rx : -rx;
+    tc = -ry;
+    ma = az;
+  }
+
+  sample(faces[face], 0.5f * (sc / ma + 1), 0.5f * (tc / ma + 1), rgba);
+}
+
+void AdsFragments::fetch(unsigned ll, const Image* colors, const Image* norm_spec,
+                         const Image* night_lights, float u, float v) {
+  float texel[4];
+  sample(colors, u, v, texel);
+  for(unsigned cc = 0; cc < 4; ++cc) this->colors[cc][ll] = texel[cc];
+  sample(norm_spec, u, v, texel);
+  for(unsigned cc = 0; cc < 4; ++cc) this->norm_spec[cc][ll] = texel[cc];
+  sample(night_lights, u, v, texel);
+  for(unsigned cc = 0; cc < 4; ++cc) this->night_lights[cc][ll] = texel[cc];
+}
+
+void AdsFragments::clear(unsigned ll) {
+  for(unsigned cc = 0; cc < 3; ++cc) {
+    eye[cc][ll] = light[cc][ll] = 1;
+  }
+  for(unsigned cc = 0; cc < 4; ++cc) {
+    colors[cc][ll] = norm_spec[cc][ll] = night_lights[cc][ll] = 0;
+  }
+}
+
+void shade_ads(const AdsFragments& in, f4 rgb[3]) {
+  f4 nx = f4::load(in.norm_spec[0]) * 2.0f - 1.0f;
+  f4 ny = f4::load(in.norm_spec[1]) * 2.0f - 1.0f;
+  f4 nz = f4::load(in.norm_spec[2]) * 2.0f - 1.0f;
+  f4 nlen = f4::sqrt(nx*nx + ny*ny + nz*nz);
+  nx = nx / nlen; ny = ny / nlen; nz = nz / nlen;
+
+  f4 lx = f4::load(in.light[0]), ly = f4::load(in.light[1]), lz = f4::load(in.light[2]);
+  f4 ex = f4::load(in.eye[0]), ey = f4::load(in.eye[1]), ez = f4::load(in.eye[2]);
+
+  f4 diffuse = nx*lx + ny*ly + nz*lz;
+  f4 dark = diffuse <= f4(0.0f);
+  diffuse = f4::select(dark, f4(0.0f), diffuse);
+
+  // night lights only on the dark side and only the bright parts
+  f4 nr = f4::load(in.night_lights[0]), ng = f4::load(in.night_lights[1]);
+  f4 nb = f4::load(in.night_lights[2]), na = f4::load(in.night_lights[3]);
+  f4 bright = f4(0.6f) <= f4::sqrt(nr*nr + ng*ng + nb*nb);
+  f4 lit = dark & bright;
+  nr = f4::select(lit, nr, f4(0.0f));
+  ng = f4::select(lit, ng, f4(0.0f));
+  nb = f4::select(lit, nb, f4(0.0f));
+  na = f4::select(lit, na, f4(0.0f));
+
+  f4 llen = f4::sqrt(lx*lx + ly*ly + lz*lz);
+  lx = lx / llen; ly = ly / llen; lz = lz / llen;
+  f4 elen = f4::sqrt(ex*ex + ey*ey + ez*ez);
+  ex = ex / elen; ey = ey / elen; ez = ez / elen;
+
+  f4 k = diffuse + ambient;
+  f4 cr = k * f4::load(in.colors[0]) + nr;
+  f4 cg = k * f4::load(in.colors[1]) + ng;
+  f4 cb = k * f4::load(in.colors[2]) + nb;
+  f4 ca = k * f4::load(in.colors[3]) + na;
+
+  // reflect(-lightDir, normal)
+  f4 ndotl = nx*lx + ny*ly + nz*lz;
+  f4 rx = ndotl * nx * 2.0f - lx;
+  f4 ry = ndotl * ny * 2.0f - ly;
+  f4 rz = ndotl * nz * 2.0f - lz;
+  f4 eye_reflection = rx*ex + ry*ey + rz*ez;
+  f4 exponent = f4::load(in.norm_spec[3]) * shininess;
+
+  float base[4], power[4], powed[4];
+  eye_reflection.store(base);
+  exponent.store(power);
+  for(int ll = 0; ll < 4; ++ll) {
+    // pow of a negative is undefined in glsl, treat it as no light
+    powed[ll] = base[ll] < 0 ? 0.0f : powf(base[ll], power[ll]);
+  }
+
+  f4 spec = f4::max(f4::load(powed) * specular_intensity, f4(0.0f)) *
+    f4::sqrt(cr*cr + cg*cg + cb*cb + ca*ca);
+  // kill specular if normal is facing away from light
+  spec = f4::select(ndotl < f4(0.0f), f4(0.0f), spec);
+
+  rgb[0] = cr + spec * spec_color[0];
+  rgb[1] = cg + spec * spec_color[1];
+  rgb[2] = cb + spec * spec_color[2];
+}
@@ -0,0 +1,44 @@
+#ifndef SHADING_H
+#define SHADING_H
+
+#include "gl_headers.h"
+#include "image.h"
+#include "simd.h"
+
+// the parts of the GL pipeline the CPU renderers share: texture
+// lookups that match what GL hands the shaders and ads.frag itself.
+
+// GL_LINEAR with GL_CLAMP_TO_EDGE and no mipmaps. rgba in 0..1, alpha
+// is 1 for three channel images like GL gives back.
+void sample(const Image* im, float s, float t, float* rgba);
+
+// faces in CubeMap::from_files order
+void sample_cube(Image* const* faces, float rx, float ry, float rz, float* rgba);
+
+inline unsigned char to_byte(float c) {
+  if(!(c > 0)) return 0;
+  if(c >= 1) return 255;
+  return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+// four fragments' worth of ads.frag inputs, one lane per fragment
+struct AdsFragments {
+  float colors[4][4];
+  float norm_spec[4][4];
+  float night_lights[4][4];
+  // tangent space, not normalized
+  float eye[3][4];
+  float light[3][4];
+
+  // do the texture reads for lane ll
+  void fetch(unsigned ll, const Image* colors, const Image* norm_spec,
+             const Image* night_lights, float u, float v);
+
+  // inputs for a lane with nothing on it
+  void clear(unsigned ll);
+};
+
+// ads.frag. rgb gets the unclamped color of each lane.
+void shade_ads(const AdsFragments& in, f4 rgb[3]);
+
+#endif
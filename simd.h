@@ -0,0 +1,157 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// four floats processed together. SSE when the compiler has it,
+// otherwise plain loops that behave the same.
+
+#include <math.h>
+
+#if defined(__SSE2__) && !defined(DISABLE_SIMD)
+#include <emmintrin.h>
+#define SIMD_SSE
+#endif
+
+class f4 {
+public:
+#ifdef SIMD_SSE
+  __m128 v;
+
+  inline f4() {}
+  inline f4(__m128 v) : v(v) {}
+  inline f4(float s) : v(_mm_set1_ps(s)) {}
+  inline f4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+  inline static f4 load(const float* p) { return f4(_mm_loadu_ps(p)); }
+  inline void store(float* p) const { _mm_storeu_ps(p, v); }
+
+  inline f4 operator+(const f4& o) const { return f4(_mm_add_ps(v, o.v)); }
+  inline f4 operator-(const f4& o) const { return f4(_mm_sub_ps(v, o.v)); }
+  inline f4 operator*(const f4& o) const { return f4(_mm_mul_ps(v, o.v)); }
+  inline f4 operator/(const f4& o) const { return f4(_mm_div_ps(v, o.v)); }
+  inline f4 operator-() const { return f4(_mm_sub_ps(_mm_setzero_ps(), v)); }
+
+  // comparisons give all-ones lanes where true, for select()
+  inline f4 operator<(const f4& o) const { return f4(_mm_cmplt_ps(v, o.v)); }
+  inline f4 operator<=(const f4& o) const { return f4(_mm_cmple_ps(v, o.v)); }
+  inline f4 operator>(const f4& o) const { return f4(_mm_cmpgt_ps(v, o.v)); }
+  inline f4 operator&(const f4& o) const { return f4(_mm_and_ps(v, o.v)); }
+  inline f4 operator|(const f4& o) const { return f4(_mm_or_ps(v, o.v)); }
+
+  // lanes of mask set take a, the others b
+  inline static f4 select(const f4& mask, const f4& a, const f4& b) {
+    return f4(_mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)));
+  }
+
+  inline static f4 min(const f4& a, const f4& b) { return f4(_mm_min_ps(a.v, b.v)); }
+  inline static f4 max(const f4& a, const f4& b) { return f4(_mm_max_ps(a.v, b.v)); }
+  inline static f4 sqrt(const f4& a) { return f4(_mm_sqrt_ps(a.v)); }
+  inline static f4 abs(const f4& a) { return f4(_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)); }
+
+  // to the nearest integer, ties to even. only for |a| < 2^31.
+  inline static f4 round(const f4& a) { return f4(_mm_cvtepi32_ps(_mm_cvtps_epi32(a.v))); }
+
+  inline bool any() const { return _mm_movemask_ps(v) != 0; }
+
+  // bit ii set where lane ii of a mask is true
+  inline int movemask() const { return _mm_movemask_ps(v); }
+#else
+  float v[4];
+
+  inline f4() {}
+  inline f4(float s) { v[0] = v[1] = v[2] = v[3] = s; }
+  inline f4(float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+
+  inline static f4 load(const float* p) { return f4(p[0], p[1], p[2], p[3]); }
+  inline void store(float* p) const { for(int ii = 0; ii < 4; ++ii) p[ii] = v[ii]; }
+
+#define F4_BINOP(op)                                                    \
+  inline f4 operator op(const f4& o) const {                            \
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = v[ii] op o.v[ii];     \
+    return r;                                                           \
+  }
+  F4_BINOP(+) F4_BINOP(-) F4_BINOP(*) F4_BINOP(/)
+#undef F4_BINOP
+
+  inline f4 operator-() const { return f4(-v[0], -v[1], -v[2], -v[3]); }
+
+#define F4_CMPOP(op)                                                    \
+  inline f4 operator op(const f4& o) const {                            \
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = mask(v[ii] op o.v[ii]); \
+    return r;                                                           \
+  }
+  F4_CMPOP(<) F4_CMPOP(<=) F4_CMPOP(>)
+#undef F4_CMPOP
+
+  inline f4 operator&(const f4& o) const {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = mask(bits(v[ii]) && bits(o.v[ii]));
+    return r;
+  }
+
+  inline f4 operator|(const f4& o) const {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = mask(bits(v[ii]) || bits(o.v[ii]));
+    return r;
+  }
+
+  inline static f4 select(const f4& m, const f4& a, const f4& b) {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = bits(m.v[ii]) ? a.v[ii] : b.v[ii];
+    return r;
+  }
+
+  // same operand order as minps/maxps so NaNs come out the same way
+  inline static f4 min(const f4& a, const f4& b) {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = a.v[ii] < b.v[ii] ? a.v[ii] : b.v[ii];
+    return r;
+  }
+
+  inline static f4 max(const f4& a, const f4& b) {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = a.v[ii] > b.v[ii] ? a.v[ii] : b.v[ii];
+    return r;
+  }
+
+  inline static f4 sqrt(const f4& a) {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = sqrtf(a.v[ii]);
+    return r;
+  }
+
+  inline static f4 abs(const f4& a) {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = fabsf(a.v[ii]);
+    return r;
+  }
+
+  inline static f4 round(const f4& a) {
+    f4 r; for(int ii = 0; ii < 4; ++ii) r.v[ii] = rintf(a.v[ii]);
+    return r;
+  }
+
+  inline bool any() const {
+    return bits(v[0]) || bits(v[1]) || bits(v[2]) || bits(v[3]);
+  }
+
+  inline int movemask() const {
+    int m = 0;
+    for(int ii = 0; ii < 4; ++ii) m |= (int)(bits(v[ii]) ? 1 : 0) << ii;
+    return m;
+  }
+
+private:
+  inline static float mask(bool b) {
+    union { unsigned u; float f; } m;
+    m.u = b ? 0xffffffffu : 0;
+    return m.f;
+  }
+
+  inline static bool bits(float f) {
+    union { unsigned u; float f; } m;
+    m.f = f;
+    return m.u != 0;
+  }
+#endif
+
+  inline float operator[](int ii) const {
+    float lanes[4];
+    store(lanes);
+    return lanes[ii];
+  }
+};
+
+#endif
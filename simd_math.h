@@ -0,0 +1,63 @@
+#ifndef SIMD_MATH_H
+#define SIMD_MATH_H
+
+#include "simd.h"
+
+// trig on four lanes at a time with the cephes single precision
+// polynomials, good to a couple of ulps over the ranges angles usually
+// come in (|x| up to a few thousand radians).
+
+// sine and cosine of x together since they share the range reduction
+inline void f4_sincos(const f4& x, f4* sin_out, f4* cos_out) {
+  // x = k pi/2 + r with |r| <= pi/4, pi/2 split in three so k pi/2 is
+  // taken off without losing r's low bits
+  f4 k = f4::round(x * f4(float(2 / M_PI)));
+  f4 r = x - k * f4(1.5703125f);
+  r = r - k * f4(4.837512969970703125e-4f);
+  r = r - k * f4(7.54978995489188216e-8f);
+
+  f4 z = r * r;
+  f4 s = r + r * z * (f4(-1.6666654611e-1f) +
+                      z * (f4(8.3321608736e-3f) + z * f4(-1.9515295891e-4f)));
+  f4 c = f4(1) - z * f4(0.5f) +
+    z * z * (f4(4.166664568298827e-2f) +
+             z * (f4(-1.388731625493765e-3f) + z * f4(2.443315711809948e-5f)));
+
+  // the quadrant k mod 4 read off k/4 - round(k/4), which is one of 0,
+  // 1/4, +-1/2 or -1/4
+  f4 q = k * f4(0.25f);
+  q = q - f4::round(q);
+  f4 odd = (f4(0.125f) < f4::abs(q)) & (f4::abs(q) < f4(0.375f));
+  f4 neg_sin = (q < f4(-0.125f)) | (f4(0.375f) < q);
+  f4 neg_cos = (f4(0.125f) < q) | (q < f4(-0.375f));
+
+  f4 sn = f4::select(odd, c, s);
+  f4 cs = f4::select(odd, s, c);
+  *sin_out = f4::select(neg_sin, -sn, sn);
+  *cos_out = f4::select(neg_cos, -cs, cs);
+}
+
+// atan2 with the usual quadrants. atan2(0, 0) is 0.
+inline f4 f4_atan2(const f4& y, const f4& x) {
+  f4 ax = f4::abs(x);
+  f4 ay = f4::abs(y);
+  f4 hi = f4::max(ax, ay);
+  f4 lo = f4::min(ax, ay);
+
+  // t in [0, 1], then folded to |t| <= tan(pi/8) around pi/4
+  f4 t = f4::select(f4(0) < hi, lo / hi, f4(0));
+  f4 big = f4(0.4142135623730950f) < t;
+  t = f4::select(big, (t - f4(1)) / (t + f4(1)), t);
+
+  f4 z = t * t;
+  f4 a = t + t * z * (f4(-3.33329491539e-1f) +
+                      z * (f4(1.99777106478e-1f) +
+                           z * (f4(-1.38776856032e-1f) + z * f4(8.05374449538e-2f))));
+  a = f4::select(big, a + f4(float(M_PI / 4)), a);
+
+  a = f4::select(ax < ay, f4(float(M_PI / 2)) - a, a);
+  a = f4::select(x < f4(0), f4(float(M_PI)) - a, a);
+  return f4::select(y < f4(0), -a, a);
+}
+
+#endif
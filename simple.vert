@@ -2,8 +2,7 @@ attribute vec3 vertex;
 attribute vec3 normal;
 attribute vec2 tcoord0;
 
-uniform mat4 mv;
-uniform mat4 perspective;
+#include "uniform_blocks.glsl"
 
 varying vec2 tcoord;
 varying vec3 vnormal;
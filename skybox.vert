@@ -1,6 +1,6 @@
 attribute vec3 vertex;
-uniform mat4 mv;
-uniform mat4 perspective_inv;
+
+#include "uniform_blocks.glsl"
 
 varying vec3 vvertex;
 
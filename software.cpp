@@ -0,0 +1,349 @@
+#include "software.h"
+#include "shading.h"
+#include "utils.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+// skybox.vert draws its quad at this depth
+static const float sky_depth = 0.99f;
+
+static const unsigned vertex_batch = 4096;
+
+// column major like Matrix::data
+static inline float m_elm(const float* m, unsigned r, unsigned c) {
+  return m[c*4+r];
+}
+
+SoftwareRenderer::SoftwareRenderer(ThreadPool* pool, Image* colors, Image* norm_spec,
+                                   Image* night_lights, Image* sky[6])
+  : pool(pool), colors(colors), norm_spec(norm_spec), night_lights(night_lights),
+    out(NULL), width(0), height(0), tiles_x(0), tiles_y(0) {
+  for(unsigned ii = 0; ii < 6; ++ii) {
+    this->sky[ii] = sky[ii];
+  }
+}
+
+void SoftwareRenderer::set_mesh(const Points& vertices, const Points& normals,
+                                const Points& tangents, const TexCoords& tcoords) {
+  this->vertices = vertices;
+  this->normals = normals;
+  this->tangents = tangents;
+  this->tcoords = tcoords;
+  clipped.resize(vertices.size());
+}
+
+// ads.vert for one batch of vertices
+void SoftwareRenderer::vertex_job(void* ctx, unsigned index) {
+  SoftwareRenderer* r = (SoftwareRenderer*)ctx;
+  const float* mv = r->mv;
+  const float* p = r->perspective;
+
+  unsigned start = index * vertex_batch;
+  unsigned end = std::min(start + vertex_batch, (unsigned)r->vertices.size());
+
+  for(unsigned ii = start; ii < end; ++ii) {
+    const Point& in = r->vertices[ii];
+    const Point& n_in = r->normals[ii];
+    const Point& t_in = r->tangents[ii];
+
+    float vx = m_elm(mv,0,0)*in.x + m_elm(mv,0,1)*in.y + m_elm(mv,0,2)*in.z + m_elm(mv,0,3);
+    float vy = m_elm(mv,1,0)*in.x + m_elm(mv,1,1)*in.y + m_elm(mv,1,2)*in.z + m_elm(mv,1,3);
+    float vz = m_elm(mv,2,0)*in.x + m_elm(mv,2,1)*in.y + m_elm(mv,2,2)*in.z + m_elm(mv,2,3);
+    float vw = m_elm(mv,3,0)*in.x + m_elm(mv,3,1)*in.y + m_elm(mv,3,2)*in.z + m_elm(mv,3,3);
+
+    Vector vertex(vx, vy, vz);
+    Vector normal(m_elm(mv,0,0)*n_in.x + m_elm(mv,0,1)*n_in.y + m_elm(mv,0,2)*n_in.z,
+                  m_elm(mv,1,0)*n_in.x + m_elm(mv,1,1)*n_in.y + m_elm(mv,1,2)*n_in.z,
+                  m_elm(mv,2,0)*n_in.x + m_elm(mv,2,1)*n_in.y + m_elm(mv,2,2)*n_in.z);
+    Vector tangent(m_elm(mv,0,0)*t_in.x + m_elm(mv,0,1)*t_in.y + m_elm(mv,0,2)*t_in.z,
+                   m_elm(mv,1,0)*t_in.x + m_elm(mv,1,1)*t_in.y + m_elm(mv,1,2)*t_in.z,
+                   m_elm(mv,2,0)*t_in.x + m_elm(mv,2,1)*t_in.y + m_elm(mv,2,2)*t_in.z);
+    Vector bitangent = normal.cross(tangent);
+
+    // into tangent space
+    Vector eye = (-vertex).norm();
+    Vector light = (r->light + (-vertex)).norm();
+
+    ClipVertex& out = r->clipped[ii];
+    out.x = m_elm(p,0,0)*vx + m_elm(p,0,1)*vy + m_elm(p,0,2)*vz + m_elm(p,0,3)*vw;
+    out.y = m_elm(p,1,0)*vx + m_elm(p,1,1)*vy + m_elm(p,1,2)*vz + m_elm(p,1,3)*vw;
+    out.z = m_elm(p,2,0)*vx + m_elm(p,2,1)*vy + m_elm(p,2,2)*vz + m_elm(p,2,3)*vw;
+    out.w = m_elm(p,3,0)*vx + m_elm(p,3,1)*vy + m_elm(p,3,2)*vz + m_elm(p,3,3)*vw;
+
+    out.attr[0] = r->tcoords[ii].u;
+    out.attr[1] = r->tcoords[ii].v;
+    out.attr[2] = tangent.dot(eye);
+    out.attr[3] = bitangent.dot(eye);
+    out.attr[4] = normal.dot(eye);
+    out.attr[5] = tangent.dot(light);
+    out.attr[6] = bitangent.dot(light);
+    out.attr[7] = normal.dot(light);
+  }
+}
+
+void SoftwareRenderer::setup_triangle(const ClipVertex* v0, const ClipVertex* v1,
+                                      const ClipVertex* v2) {
+  const ClipVertex* v[3] = {v0, v1, v2};
+  Triangle t;
+
+  for(unsigned ii = 0; ii < 3; ++ii) {
+    float iw = 1.0f / v[ii]->w;
+    t.x[ii] = (v[ii]->x * iw + 1) * 0.5f * width;
+    t.y[ii] = (v[ii]->y * iw + 1) * 0.5f * height;
+    t.z[ii] = v[ii]->z * iw;
+    t.iw[ii] = iw;
+    for(unsigned aa = 0; aa < NATTRIBUTES; ++aa) {
+      t.attr[ii][aa] = v[ii]->attr[aa] * iw;
+    }
+  }
+
+  // counter clockwise is front facing, everything else is culled
+  float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.y[1] - t.y[0]) * (t.x[2] - t.x[0]);
+  if(!(area > 0)) return;
+  t.inv_area = 1.0f / area;
+
+  float minx = std::min(t.x[0], std::min(t.x[1], t.x[2]));
+  float maxx = std::max(t.x[0], std::max(t.x[1], t.x[2]));
+  float miny = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+  float maxy = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+
+  // pixels whose centers might be inside, clamped to the viewport
+  // before converting so far off screen corners can't overflow
+  t.minx = (int)floorf(std::max(minx - 0.5f, 0.0f));
+  t.miny = (int)floorf(std::max(miny - 0.5f, 0.0f));
+  t.maxx = (int)ceilf(std::min(maxx - 0.5f, width - 1.0f));
+  t.maxy = (int)ceilf(std::min(maxy - 0.5f, height - 1.0f));
+  if(t.minx > t.maxx || t.miny > t.maxy) return;
+
+  unsigned index = triangles.size();
+  triangles.push_back(t);
+
+  for(int ty = t.miny / TILE_SIZE; ty <= t.maxy / TILE_SIZE; ++ty) {
+    for(int tx = t.minx / TILE_SIZE; tx <= t.maxx / TILE_SIZE; ++tx) {
+      bins[ty * tiles_x + tx].push_back(index);
+    }
+  }
+}
+
+static SoftwareRenderer::ClipVertex lerp_vertex(const SoftwareRenderer::ClipVertex& a,
+                                                const SoftwareRenderer::ClipVertex& b, float s);
+
+// clip against the near plane (z >= -w). the globe never crosses the
+// others far enough to matter and the rasterizer clamps to the viewport.
+void SoftwareRenderer::clip_triangle(const ClipVertex& v0, const ClipVertex& v1,
+                                     const ClipVertex& v2) {
+  const ClipVertex* in[3] = {&v0, &v1, &v2};
+  float d[3];
+  unsigned inside = 0;
+  for(unsigned ii = 0; ii < 3; ++ii) {
+    d[ii] = in[ii]->z + in[ii]->w;
+    if(d[ii] >= 0) inside++;
+  }
+
+  if(inside == 3) {
+    setup_triangle(&v0, &v1, &v2);
+    return;
+  }
+  if(inside == 0) return;
+
+  // at most a quad survives
+  ClipVertex poly[4];
+  unsigned npoly = 0;
+  for(unsigned ii = 0; ii < 3; ++ii) {
+    unsigned jj = (ii + 1) % 3;
+    if(d[ii] >= 0) poly[npoly++] = *in[ii];
+    if((d[ii] >= 0) != (d[jj] >= 0)) {
+      poly[npoly++] = lerp_vertex(*in[ii], *in[jj], d[ii] / (d[ii] - d[jj]));
+    }
+  }
+
+  for(unsigned ii = 2; ii < npoly; ++ii) {
+    setup_triangle(&poly[0], &poly[ii-1], &poly[ii]);
+  }
+}
+
+static SoftwareRenderer::ClipVertex lerp_vertex(const SoftwareRenderer::ClipVertex& a,
+                                                const SoftwareRenderer::ClipVertex& b,
+                                                float s) {
+  SoftwareRenderer::ClipVertex r;
+  r.x = a.x + (b.x - a.x) * s;
+  r.y = a.y + (b.y - a.y) * s;
+  r.z = a.z + (b.z - a.z) * s;
+  r.w = a.w + (b.w - a.w) * s;
+  for(unsigned aa = 0; aa < SoftwareRenderer::NATTRIBUTES; ++aa) {
+    r.attr[aa] = a.attr[aa] + (b.attr[aa] - a.attr[aa]) * s;
+  }
+  return r;
+}
+
+void SoftwareRenderer::tile_job(void* ctx, unsigned index) {
+  SoftwareRenderer* r = (SoftwareRenderer*)ctx;
+  r->render_tile(index % r->tiles_x, index / r->tiles_x);
+}
+
+void SoftwareRenderer::render_tile(unsigned tx, unsigned ty) {
+  const int x0 = tx * TILE_SIZE;
+  const int y0 = ty * TILE_SIZE;
+  const int x1 = std::min(x0 + TILE_SIZE, (int)width);
+  const int y1 = std::min(y0 + TILE_SIZE, (int)height);
+
+  // visibility buffer: nearest triangle and its barycentrics per pixel
+  float depth[TILE_SIZE * TILE_SIZE];
+  int visible[TILE_SIZE * TILE_SIZE];
+  float bary1[TILE_SIZE * TILE_SIZE];
+  float bary2[TILE_SIZE * TILE_SIZE];
+
+  for(unsigned ii = 0; ii < TILE_SIZE * TILE_SIZE; ++ii) {
+    depth[ii] = 1.0f;
+    visible[ii] = -1;
+  }
+
+  const std::vector<unsigned>& bin = bins[ty * tiles_x + tx];
+  for(unsigned bb = 0; bb < bin.size(); ++bb) {
+    const Triangle& t = triangles[bin[bb]];
+
+    int px0 = std::max(x0, t.minx);
+    int px1 = std::min(x1 - 1, t.maxx);
+    int py0 = std::max(y0, t.miny);
+    int py1 = std::min(y1 - 1, t.maxy);
+
+    // edge ii is opposite corner ii: e(p) = a*px + b*py + c
+    float ea[3], eb[3], ec[3];
+    bool top_left[3];
+    for(unsigned ii = 0; ii < 3; ++ii) {
+      unsigned j = (ii + 1) % 3;
+      unsigned k = (ii + 2) % 3;
+      ea[ii] = t.y[j] - t.y[k];
+      eb[ii] = t.x[k] - t.x[j];
+      ec[ii] = -(ea[ii] * t.x[j] + eb[ii] * t.y[j]);
+      // pixels exactly on a shared edge belong to one side only
+      top_left[ii] = ea[ii] > 0 || (ea[ii] == 0 && eb[ii] < 0);
+    }
+
+    for(int py = py0; py <= py1; ++py) {
+      float cy = py + 0.5f;
+      for(int px = px0; px <= px1; ++px) {
+        float cx = px + 0.5f;
+        float e0 = ea[0] * cx + eb[0] * cy + ec[0];
+        float e1 = ea[1] * cx + eb[1] * cy + ec[1];
+        float e2 = ea[2] * cx + eb[2] * cy + ec[2];
+
+        if(e0 < 0 || (e0 == 0 && !top_left[0])) continue;
+        if(e1 < 0 || (e1 == 0 && !top_left[1])) continue;
+        if(e2 < 0 || (e2 == 0 && !top_left[2])) continue;
+
+        float b1 = e1 * t.inv_area;
+        float b2 = e2 * t.inv_area;
+        float b0 = 1 - b1 - b2;
+        float z = b0 * t.z[0] + b1 * t.z[1] + b2 * t.z[2];
+
+        unsigned idx = (py - y0) * TILE_SIZE + (px - x0);
+        if(z < depth[idx] && z >= -1) {
+          depth[idx] = z;
+          visible[idx] = bin[bb];
+          bary1[idx] = b1;
+          bary2[idx] = b2;
+        }
+      }
+    }
+  }
+
+  // shade four pixels at a time
+  const float* st = sky_transform;
+  for(int py = y0; py < y1; ++py) {
+    unsigned char* row = out->data + (size_t)py * out->w * out->ch;
+    float ndc_y = (py + 0.5f) / height * 2 - 1;
+
+    for(int px = x0; px < x1; px += 4) {
+      AdsFragments frag;
+      float skyc[4][4];
+      bool globe[4];
+      bool any_globe = false;
+
+      for(int ll = 0; ll < 4; ++ll) {
+        int x = px + ll;
+        unsigned idx = (py - y0) * TILE_SIZE + (x - x0);
+        // where the skybox quad isn't hidden by the globe
+        globe[ll] = x < x1 && visible[idx] >= 0 && !(sky_depth < depth[idx]);
+
+        if(globe[ll]) {
+          any_globe = true;
+          const Triangle& t = triangles[visible[idx]];
+          float b1 = bary1[idx];
+          float b2 = bary2[idx];
+          float b0 = 1 - b1 - b2;
+          float w = 1.0f / (b0 * t.iw[0] + b1 * t.iw[1] + b2 * t.iw[2]);
+          float a[NATTRIBUTES];
+          for(unsigned aa = 0; aa < NATTRIBUTES; ++aa) {
+            a[aa] = (b0 * t.attr[0][aa] + b1 * t.attr[1][aa] + b2 * t.attr[2][aa]) * w;
+          }
+          for(unsigned cc = 0; cc < 3; ++cc) {
+            frag.eye[cc][ll] = a[2+cc];
+            frag.light[cc][ll] = a[5+cc];
+          }
+          frag.fetch(ll, colors, norm_spec, night_lights, a[0], a[1]);
+        } else {
+          frag.clear(ll);
+
+          // skybox.vert: mv * perspective_inv * vec4(vertex, 1), no divide
+          float ndc_x = (x + 0.5f) / width * 2 - 1;
+          float dir[3];
+          for(unsigned rr = 0; rr < 3; ++rr) {
+            dir[rr] = m_elm(st,rr,0) * ndc_x + m_elm(st,rr,1) * ndc_y +
+              m_elm(st,rr,2) * sky_depth + m_elm(st,rr,3);
+          }
+          sample_cube(sky, dir[0], dir[1], dir[2], skyc[ll]);
+        }
+      }
+
+      f4 result[3];
+      if(any_globe) shade_ads(frag, result);
+
+      float rgb[3][4];
+      for(unsigned cc = 0; cc < 3; ++cc) result[cc].store(rgb[cc]);
+
+      for(int ll = 0; ll < 4 && px + ll < x1; ++ll) {
+        unsigned char* dst = row + (px + ll) * out->ch;
+        for(unsigned cc = 0; cc < 3; ++cc) {
+          dst[cc] = to_byte(globe[ll] ? rgb[cc][ll] : skyc[ll][cc]);
+        }
+      }
+    }
+  }
+}
+
+void SoftwareRenderer::render(Image* out, unsigned nrows,
+                              const Matrix& mv, const Matrix& perspective,
+                              const Vector& light, const Matrix& sky_mv,
+                              const Matrix& perspective_inv) {
+  if(out->ch != 3) fail_exit("software renderer writes 3 channel images");
+
+  this->out = out;
+  width = out->w;
+  height = nrows;
+  this->light = light;
+  memcpy(this->mv, mv.data, sizeof(this->mv));
+  memcpy(this->perspective, perspective.data, sizeof(this->perspective));
+
+  Matrix sky_mv_copy(sky_mv);
+  Matrix sky = sky_mv_copy * perspective_inv;
+  memcpy(sky_transform, sky.data, sizeof(sky_transform));
+
+  tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+  tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+  bins.resize(tiles_x * tiles_y);
+  for(unsigned ii = 0; ii < bins.size(); ++ii) bins[ii].clear();
+
+  unsigned nbatches = (vertices.size() + vertex_batch - 1) / vertex_batch;
+  pool->parallel_for(nbatches, vertex_job, this);
+
+  // binning stays serial so every tile sees triangles in draw order
+  triangles.clear();
+  for(unsigned ii = 0; ii + 2 < clipped.size(); ii += 3) {
+    clip_triangle(clipped[ii], clipped[ii+1], clipped[ii+2]);
+  }
+
+  pool->parallel_for(tiles_x * tiles_y, tile_job, this);
+}
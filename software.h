@@ -0,0 +1,93 @@
+#ifndef SOFTWARE_H
+#define SOFTWARE_H
+
+#include "gl_headers.h"
+#include "image.h"
+#include "matrix.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+// a renderer that draws the globe and skybox without GL
+class CpuRenderer {
+public:
+  virtual ~CpuRenderer() {}
+
+  // render into the first nrows rows of out, bottom row first like
+  // glReadPixels. mv/perspective/light are the ads uniforms and
+  // sky_mv/perspective_inv the skybox ones.
+  virtual void render(Image* out, unsigned nrows,
+                      const Matrix& mv, const Matrix& perspective, const Vector& light,
+                      const Matrix& sky_mv, const Matrix& perspective_inv) = 0;
+};
+
+// draws the globe and skybox on the CPU the way the ads and skybox
+// programs do, for machines with no GPU. the screen is cut into tiles
+// that are rasterized in parallel into a visibility buffer and then
+// shaded four pixels at a time.
+class SoftwareRenderer : public CpuRenderer {
+public:
+  // sky holds the cube faces in CubeMap::from_files order
+  SoftwareRenderer(ThreadPool* pool, Image* colors, Image* norm_spec,
+                   Image* night_lights, Image* sky[6]);
+
+  // drawn as GL_TRIANGLES, the same arrays the ads program is fed
+  void set_mesh(const Points& vertices, const Points& normals,
+                const Points& tangents, const TexCoords& tcoords);
+
+  void render(Image* out, unsigned nrows,
+              const Matrix& mv, const Matrix& perspective, const Vector& light,
+              const Matrix& sky_mv, const Matrix& perspective_inv);
+
+  enum {
+    TILE_SIZE = 64,
+    // u, v, eyeDir and lightDir
+    NATTRIBUTES = 8
+  };
+
+  struct ClipVertex {
+    float x, y, z, w;
+    float attr[NATTRIBUTES];
+  };
+
+  struct Triangle {
+    // window position, ndc depth and 1/w of each corner
+    float x[3], y[3], z[3], iw[3];
+    // attributes premultiplied by 1/w for perspective correction
+    float attr[3][NATTRIBUTES];
+    float inv_area;
+    int minx, miny, maxx, maxy;
+  };
+
+private:
+  static void vertex_job(void* ctx, unsigned index);
+  static void tile_job(void* ctx, unsigned index);
+
+  void setup_triangle(const ClipVertex* v0, const ClipVertex* v1, const ClipVertex* v2);
+  void clip_triangle(const ClipVertex& v0, const ClipVertex& v1, const ClipVertex& v2);
+  void render_tile(unsigned tx, unsigned ty);
+
+  ThreadPool* pool;
+  Image* colors;
+  Image* norm_spec;
+  Image* night_lights;
+  Image* sky[6];
+
+  Points vertices;
+  Points normals;
+  Points tangents;
+  TexCoords tcoords;
+
+  // per render state
+  Image* out;
+  unsigned width, height;
+  unsigned tiles_x, tiles_y;
+  float mv[16], perspective[16], sky_transform[16];
+  Vector light;
+
+  std::vector<ClipVertex> clipped;
+  std::vector<Triangle> triangles;
+  std::vector<std::vector<unsigned> > bins;
+};
+
+#endif
@@ -0,0 +1,103 @@
+#include "thread_pool.h"
+#include "utils.h"
+#include "trace.h"
+
+#include <unistd.h>
+
+ThreadPool::ThreadPool(unsigned nthreads)
+  : fn(NULL), ctx(NULL), count(0), next(0), active(0), generation(0), quit(false) {
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&work_ready, NULL);
+  pthread_cond_init(&work_done, NULL);
+
+  for(unsigned ii = 1; ii < nthreads; ++ii) {
+    pthread_t thread;
+    if(pthread_create(&thread, NULL, worker_main, this) != 0) {
+      fail_exit("failed to start worker thread");
+    }
+    threads.push_back(thread);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  pthread_mutex_lock(&mutex);
+  quit = true;
+  pthread_cond_broadcast(&work_ready);
+  pthread_mutex_unlock(&mutex);
+
+  for(unsigned ii = 0; ii < threads.size(); ++ii) {
+    pthread_join(threads[ii], NULL);
+  }
+
+  pthread_cond_destroy(&work_done);
+  pthread_cond_destroy(&work_ready);
+  pthread_mutex_destroy(&mutex);
+}
+
+unsigned ThreadPool::default_size() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (unsigned)n : 1;
+}
+
+// claim items until there are none left. called with the mutex held
+// and returns with it held.
+void ThreadPool::run_items() {
+  while(next < count) {
+    unsigned item = next++;
+    active++;
+    pthread_mutex_unlock(&mutex);
+
+    {
+      TRACE_ZONE("pool item");
+      fn(ctx, item);
+    }
+
+    pthread_mutex_lock(&mutex);
+    active--;
+  }
+}
+
+void* ThreadPool::worker_main(void* arg) {
+  ThreadPool* pool = (ThreadPool*)arg;
+  trace_thread_name("pool worker");
+  unsigned seen = 0;
+
+  pthread_mutex_lock(&pool->mutex);
+  while(true) {
+    while(!pool->quit && pool->generation == seen) {
+      pthread_cond_wait(&pool->work_ready, &pool->mutex);
+    }
+    if(pool->quit) break;
+
+    seen = pool->generation;
+    pool->run_items();
+    if(pool->next >= pool->count && pool->active == 0) {
+      pthread_cond_signal(&pool->work_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+void ThreadPool::parallel_for(unsigned count, ParallelFn fn, void* ctx) {
+  if(count == 0) return;
+
+  if(threads.empty()) {
+    for(unsigned ii = 0; ii < count; ++ii) fn(ctx, ii);
+    return;
+  }
+
+  pthread_mutex_lock(&mutex);
+  this->fn = fn;
+  this->ctx = ctx;
+  this->count = count;
+  this->next = 0;
+  generation++;
+  pthread_cond_broadcast(&work_ready);
+
+  run_items();
+  while(next < count || active > 0) {
+    pthread_cond_wait(&work_done, &mutex);
+  }
+  pthread_mutex_unlock(&mutex);
+}
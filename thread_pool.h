@@ -0,0 +1,43 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <vector>
+
+typedef void (*ParallelFn)(void* ctx, unsigned index);
+
+// a fixed set of threads that run the iterations of parallel_for. the
+// calling thread works too, so a pool of one runs everything inline.
+class ThreadPool {
+public:
+  ThreadPool(unsigned nthreads);
+  ~ThreadPool();
+
+  // run fn(ctx, ii) for every ii in [0, count) and wait for all of them
+  void parallel_for(unsigned count, ParallelFn fn, void* ctx);
+
+  unsigned size() const { return threads.size() + 1; }
+
+  // one per online cpu
+  static unsigned default_size();
+
+private:
+  static void* worker_main(void* arg);
+  void run_items();
+
+  std::vector<pthread_t> threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t work_ready;
+  pthread_cond_t work_done;
+
+  // the current job. generation changes each time one is posted.
+  ParallelFn fn;
+  void* ctx;
+  unsigned count;
+  unsigned next;
+  unsigned active;
+  unsigned generation;
+  bool quit;
+};
+
+#endif
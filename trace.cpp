@@ -0,0 +1,212 @@
+#include "trace.h"
+#include "utils.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+bool trace_enabled = false;
+bool trace_tsc = false;
+
+// a power of two so positions wrap with a mask
+#define TRACE_RING_SIZE (16 * 1024)
+#define TRACE_FLUSH_MS 10
+
+struct TraceEvent {
+  const char* name;
+  unsigned long long start;
+  unsigned long long end;
+};
+
+// one producer, the thread it belongs to, and one consumer, the flush
+// thread. head and tail only ever grow, each is written by one side.
+struct TraceRing {
+  TraceEvent events[TRACE_RING_SIZE];
+  unsigned head;
+  unsigned tail;
+  unsigned dropped;
+  unsigned tid;
+  std::string name;
+};
+
+static __thread TraceRing* thread_ring = NULL;
+
+// registration and everything the flush thread owns
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trace_wake = PTHREAD_COND_INITIALIZER;
+static std::vector<TraceRing*> rings;
+static pthread_t flush_thread;
+static bool flush_quit = false;
+static FILE* trace_file = NULL;
+static bool first_event = true;
+static int trace_pid;
+
+// ticks to microseconds since trace_init
+static unsigned long long base_ticks;
+static double us_per_tick;
+
+static bool invariant_tsc() {
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned eax, ebx, ecx, edx;
+  if(__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && eax >= 0x80000007) {
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    return (edx >> 8) & 1;
+  }
+#endif
+  return false;
+}
+
+static unsigned long long monotonic_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static TraceRing* ring_for_thread() {
+  if(thread_ring) return thread_ring;
+
+  TraceRing* ring = new TraceRing();
+  ring->head = ring->tail = ring->dropped = 0;
+  pthread_mutex_lock(&trace_mutex);
+  ring->tid = rings.size() + 1;
+  ring->name = stdstring("thread %u", ring->tid);
+  rings.push_back(ring);
+  pthread_mutex_unlock(&trace_mutex);
+
+  thread_ring = ring;
+  return ring;
+}
+
+void trace_record(const char* name, unsigned long long start, unsigned long long end) {
+  TraceRing* ring = ring_for_thread();
+  unsigned head = ring->head;
+  if(head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == TRACE_RING_SIZE) {
+    ring->dropped++;
+    return;
+  }
+
+  TraceEvent* event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+  event->name = name;
+  event->start = start;
+  event->end = end;
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_thread_name(const char* name) {
+  if(!trace_enabled) return;
+  TraceRing* ring = ring_for_thread();
+  pthread_mutex_lock(&trace_mutex);
+  ring->name = name;
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+static double trace_us(unsigned long long ticks) {
+  return ticks > base_ticks ? (ticks - base_ticks) * us_per_tick : 0.0;
+}
+
+// write out whatever the rings hold. called with trace_mutex held.
+static void drain_rings() {
+  for(size_t ii = 0; ii < rings.size(); ++ii) {
+    TraceRing* ring = rings[ii];
+    unsigned head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    for(unsigned pos = ring->tail; pos != head; ++pos) {
+      const TraceEvent& event = ring->events[pos & (TRACE_RING_SIZE - 1)];
+      double start = trace_us(event.start);
+      fprintf(trace_file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+              "\"ts\":%.3f,\"dur\":%.3f}", first_event ? "" : ",", event.name, trace_pid,
+              ring->tid, start, trace_us(event.end) - start);
+      first_event = false;
+    }
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+  }
+}
+
+static void* flush_main(void*) {
+  pthread_mutex_lock(&trace_mutex);
+  while(!flush_quit) {
+    drain_rings();
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += TRACE_FLUSH_MS * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&trace_wake, &trace_mutex, &deadline);
+  }
+  pthread_mutex_unlock(&trace_mutex);
+  return NULL;
+}
+
+static void trace_shutdown() {
+  if(!trace_enabled) return;
+  trace_enabled = false;
+
+  pthread_mutex_lock(&trace_mutex);
+  flush_quit = true;
+  pthread_cond_signal(&trace_wake);
+  pthread_mutex_unlock(&trace_mutex);
+  pthread_join(flush_thread, NULL);
+
+  // zones that were open as tracing stopped are lost
+  unsigned dropped = 0;
+  pthread_mutex_lock(&trace_mutex);
+  drain_rings();
+  for(size_t ii = 0; ii < rings.size(); ++ii) {
+    fprintf(trace_file, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+            "\"args\":{\"name\":\"%s\"}}", first_event ? "" : ",", trace_pid, rings[ii]->tid,
+            rings[ii]->name.c_str());
+    first_event = false;
+    dropped += rings[ii]->dropped;
+  }
+  pthread_mutex_unlock(&trace_mutex);
+
+  fprintf(trace_file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+  fclose(trace_file);
+  trace_file = NULL;
+  if(dropped) {
+    LOGW("trace: %u events dropped on full rings", dropped);
+  }
+}
+
+void trace_init(bool per_process) {
+  const char* env = getenv("TRACE");
+  if(!env || !*env || trace_enabled) return;
+
+  trace_pid = getpid();
+  std::string path = per_process ? stdstring("%s.%d", env, trace_pid) : std::string(env);
+  trace_file = fopen(path.c_str(), "w");
+  if(!trace_file) {
+    LOGW("trace: can't write %s: %s", path.c_str(), strerror(errno));
+    return;
+  }
+  fprintf(trace_file, "{\"traceEvents\":[");
+
+  // how fast the TSC ticks, against the clock
+  trace_tsc = invariant_tsc();
+  base_ticks = trace_ticks();
+  us_per_tick = 0.001;
+  if(trace_tsc) {
+    unsigned long long ns0 = monotonic_ns();
+    usleep(20000);
+    unsigned long long ticks = trace_ticks() - base_ticks;
+    us_per_tick = (monotonic_ns() - ns0) / 1000.0 / ticks;
+  }
+
+  flush_quit = false;
+  if(pthread_create(&flush_thread, NULL, flush_main, NULL) != 0) {
+    fail_exit("failed to start the trace flush thread");
+  }
+  trace_enabled = true;
+  atexit(trace_shutdown);
+  LOGI("trace: writing %s, timed with the %s", path.c_str(), trace_tsc ? "tsc" : "clock");
+}
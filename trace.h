@@ -0,0 +1,62 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// scoped zones for a timeline of where the time goes, written in the
+// Chrome trace event format (load it in chrome://tracing or Perfetto).
+// TRACE names the output file, without it tracing is off and a zone
+// costs a test of trace_enabled.
+//
+// each thread records into its own ring of events with no locks. a
+// background thread drains the rings to the file every few ms, and a
+// ring that fills before then drops events rather than wait. zones are
+// timed with the TSC where it's invariant, the monotonic clock
+// otherwise.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <time.h>
+
+extern bool trace_enabled;
+extern bool trace_tsc;
+
+static inline unsigned long long trace_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  if(trace_tsc) return __rdtsc();
+#endif
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// reads TRACE and starts the flush thread. with per_process the pid is
+// appended to the file name, for when several processes would share
+// it. the trace is finished at exit.
+void trace_init(bool per_process = false);
+
+// what the calling thread is called in the trace
+void trace_thread_name(const char* name);
+
+// name has to outlive the trace, a string literal
+void trace_record(const char* name, unsigned long long start, unsigned long long end);
+
+class TraceZone {
+ public:
+  TraceZone(const char* name)
+    : name(name), start(trace_enabled ? trace_ticks() : 0) {}
+  ~TraceZone() {
+    if(start && trace_enabled) trace_record(name, start, trace_ticks());
+  }
+
+ private:
+  const char* name;
+  unsigned long long start;
+};
+
+#define TRACE_CAT_(a, b) a##b
+#define TRACE_CAT(a, b) TRACE_CAT_(a, b)
+
+// times the rest of the enclosing scope
+#define TRACE_ZONE(name) TraceZone TRACE_CAT(trace_zone_, __LINE__)(name)
+
+#endif
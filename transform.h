@@ -0,0 +1,447 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "matrix.h"
+
+// header only math for chaining rigid, affine and projective transforms
+// without going through Matrix. multiplying transforms doesn't multiply
+// anything, it builds a product that is only worked out when used:
+// applying one to a point pushes the point through each factor right to
+// left so no intermediate matrix is ever built, and eval() (or assigning
+// to a transform) collapses it with the cheapest composition the kinds of
+// its factors allow. vectors are plain values, at three components the
+// compiler already keeps their arithmetic in registers.
+//
+// the float versions do the same operations in the same order as the
+// matrix kernels so switching code over doesn't change its results.
+
+#if __cplusplus >= 201402L
+#define TRANSFORM_CONSTEXPR constexpr
+#else
+#define TRANSFORM_CONSTEXPR inline
+#endif
+
+template<typename T>
+class Vec3 {
+public:
+  T x, y, z;
+
+  TRANSFORM_CONSTEXPR Vec3()
+    : x(0), y(0), z(0) {
+  }
+
+  TRANSFORM_CONSTEXPR Vec3(T x, T y, T z)
+    : x(x), y(y), z(z) {
+  }
+
+  TRANSFORM_CONSTEXPR Vec3(const Point& p)
+    : x(p.x), y(p.y), z(p.z) {
+  }
+
+  inline Point point() const {
+    return Point(float(x), float(y), float(z));
+  }
+
+  TRANSFORM_CONSTEXPR T dot(const Vec3& o) const {
+    return x*o.x + y*o.y + z*o.z;
+  }
+
+  TRANSFORM_CONSTEXPR Vec3 cross(const Vec3& o) const {
+    return Vec3(y*o.z - z*o.y, z*o.x - x*o.z, x*o.y - y*o.x);
+  }
+
+  inline Vec3 norm() const {
+    T m = sqrt(dot(*this));
+    return Vec3(x/m, y/m, z/m);
+  }
+
+  TRANSFORM_CONSTEXPR Vec3 operator-() const {
+    return Vec3(-x, -y, -z);
+  }
+
+  TRANSFORM_CONSTEXPR Vec3 operator+(const Vec3& o) const {
+    return Vec3(x+o.x, y+o.y, z+o.z);
+  }
+
+  TRANSFORM_CONSTEXPR Vec3 operator-(const Vec3& o) const {
+    return Vec3(x-o.x, y-o.y, z-o.z);
+  }
+
+  TRANSFORM_CONSTEXPR Vec3 operator*(T s) const {
+    return Vec3(x*s, y*s, z*s);
+  }
+};
+
+template<typename T>
+class Vec4 {
+public:
+  T x, y, z, w;
+
+  TRANSFORM_CONSTEXPR Vec4()
+    : x(0), y(0), z(0), w(0) {
+  }
+
+  TRANSFORM_CONSTEXPR Vec4(T x, T y, T z, T w)
+    : x(x), y(y), z(z), w(w) {
+  }
+
+  TRANSFORM_CONSTEXPR Vec4(const Vec3<T>& v, T w)
+    : x(v.x), y(v.y), z(v.z), w(w) {
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<T> xyz() const {
+    return Vec3<T>(x, y, z);
+  }
+};
+
+// 3x3 kept as columns
+template<typename T>
+class Mat3 {
+public:
+  Vec3<T> c0, c1, c2;
+
+  TRANSFORM_CONSTEXPR Mat3()
+    : c0(1, 0, 0), c1(0, 1, 0), c2(0, 0, 1) {
+  }
+
+  TRANSFORM_CONSTEXPR Mat3(const Vec3<T>& c0, const Vec3<T>& c1, const Vec3<T>& c2)
+    : c0(c0), c1(c1), c2(c2) {
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<T> operator*(const Vec3<T>& v) const {
+    return c0 * v.x + c1 * v.y + c2 * v.z;
+  }
+
+  TRANSFORM_CONSTEXPR Mat3 operator*(const Mat3& o) const {
+    return Mat3(*this * o.c0, *this * o.c1, *this * o.c2);
+  }
+
+  TRANSFORM_CONSTEXPR Mat3 transpose() const {
+    return Mat3(Vec3<T>(c0.x, c1.x, c2.x),
+                Vec3<T>(c0.y, c1.y, c2.y),
+                Vec3<T>(c0.z, c1.z, c2.z));
+  }
+
+  TRANSFORM_CONSTEXPR T determinant() const {
+    return c0.dot(c1.cross(c2));
+  }
+
+  // the rows of the inverse are the cross products of the columns
+  // over the determinant
+  TRANSFORM_CONSTEXPR Mat3 inverse() const {
+    T inv_det = 1 / determinant();
+    return Mat3(c1.cross(c2) * inv_det,
+                c2.cross(c0) * inv_det,
+                c0.cross(c1) * inv_det).transpose();
+  }
+};
+
+// what a transform is tells how cheaply it composes and inverts. a
+// product is the most general of its factors.
+typedef enum {
+  TRANSFORM_RIGID,
+  TRANSFORM_AFFINE,
+  TRANSFORM_PROJECTIVE
+} TransformKind;
+
+template<typename T> class Rigid;
+template<typename T> class Affine;
+template<typename T> class Projective;
+
+template<typename T, int kind> struct TransformOfKind;
+template<typename T> struct TransformOfKind<T, TRANSFORM_RIGID> {
+  typedef Rigid<T> type;
+};
+template<typename T> struct TransformOfKind<T, TRANSFORM_AFFINE> {
+  typedef Affine<T> type;
+};
+template<typename T> struct TransformOfKind<T, TRANSFORM_PROJECTIVE> {
+  typedef Projective<T> type;
+};
+
+// everything that can appear in a product derives from this so the
+// operators below only pick up transforms
+template<typename D>
+class TransformExpr {
+public:
+  TRANSFORM_CONSTEXPR const D& self() const {
+    return static_cast<const D&>(*this);
+  }
+};
+
+template<typename A, typename B>
+class TransformProduct : public TransformExpr<TransformProduct<A, B> > {
+public:
+  typedef typename A::scalar scalar;
+  enum { kind = int(A::kind) > int(B::kind) ? int(A::kind) : int(B::kind) };
+  typedef typename TransformOfKind<scalar, kind>::type result_type;
+  typedef TransformProduct<typename B::inverse_type, typename A::inverse_type> inverse_type;
+
+  // held by value so a product can't outlive its factors
+  A a;
+  B b;
+
+  TRANSFORM_CONSTEXPR TransformProduct(const A& a, const B& b)
+    : a(a), b(b) {
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<scalar> apply_point(const Vec3<scalar>& p) const {
+    return a.apply_point(b.apply_point(p));
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<scalar> apply_vector(const Vec3<scalar>& v) const {
+    return a.apply_vector(b.apply_vector(v));
+  }
+
+  TRANSFORM_CONSTEXPR Vec4<scalar> apply(const Vec4<scalar>& v) const {
+    return a.apply(b.apply(v));
+  }
+
+  TRANSFORM_CONSTEXPR result_type eval() const {
+    return result_type::compose(result_type(a.eval()), result_type(b.eval()));
+  }
+
+  TRANSFORM_CONSTEXPR operator result_type() const {
+    return eval();
+  }
+
+  inline inverse_type inverse() const {
+    return inverse_type(b.inverse(), a.inverse());
+  }
+
+  inline Matrix matrix() const {
+    return eval().matrix();
+  }
+};
+
+template<typename A, typename B>
+TRANSFORM_CONSTEXPR TransformProduct<A, B>
+operator*(const TransformExpr<A>& a, const TransformExpr<B>& b) {
+  return TransformProduct<A, B>(a.self(), b.self());
+}
+
+// like Matrix, a transform times a 3 component value treats it as a point
+template<typename D>
+TRANSFORM_CONSTEXPR Vec3<typename D::scalar>
+operator*(const TransformExpr<D>& m, const Vec3<typename D::scalar>& p) {
+  return m.self().apply_point(p);
+}
+
+template<typename D>
+inline Point operator*(const TransformExpr<D>& m, const Point& p) {
+  return m.self().apply_point(Vec3<typename D::scalar>(p)).point();
+}
+
+template<typename D>
+TRANSFORM_CONSTEXPR Vec4<typename D::scalar>
+operator*(const TransformExpr<D>& m, const Vec4<typename D::scalar>& v) {
+  return m.self().apply(v);
+}
+
+// a rotation followed by a translation. its inverse is a transpose.
+template<typename T>
+class Rigid : public TransformExpr<Rigid<T> > {
+public:
+  typedef T scalar;
+  enum { kind = TRANSFORM_RIGID };
+  typedef Rigid inverse_type;
+
+  Mat3<T> r;
+  Vec3<T> t;
+
+  TRANSFORM_CONSTEXPR Rigid() {
+  }
+
+  TRANSFORM_CONSTEXPR Rigid(const Mat3<T>& r, const Vec3<T>& t)
+    : r(r), t(t) {
+  }
+
+  TRANSFORM_CONSTEXPR static Rigid translation(const Vec3<T>& t) {
+    return Rigid(Mat3<T>(), t);
+  }
+
+  // same as Matrix::set_rotation
+  inline static Rigid rotation(T angle, const Vec3<T>& axis) {
+    Vec3<T> n = axis.norm();
+    T s = T(sin(angle));
+    T c = T(cos(angle));
+    T one_c = 1 - c;
+    T xx = n.x * n.x, yy = n.y * n.y, zz = n.z * n.z;
+    T xy = n.x * n.y, yz = n.y * n.z, zx = n.z * n.x;
+    T xs = n.x * s, ys = n.y * s, zs = n.z * s;
+
+    return Rigid(Mat3<T>(Vec3<T>((one_c * xx) + c, (one_c * xy) + zs, (one_c * zx) - ys),
+                         Vec3<T>((one_c * xy) - zs, (one_c * yy) + c, (one_c * yz) + xs),
+                         Vec3<T>((one_c * zx) + ys, (one_c * yz) - xs, (one_c * zz) + c)),
+                 Vec3<T>());
+  }
+
+  // the rotation and translation parts of m, which had better be rigid
+  inline static Rigid from_matrix(const Matrix& m) {
+    return Rigid(Mat3<T>(Vec3<T>(m.data[0], m.data[1], m.data[2]),
+                         Vec3<T>(m.data[4], m.data[5], m.data[6]),
+                         Vec3<T>(m.data[8], m.data[9], m.data[10])),
+                 Vec3<T>(m.data[12], m.data[13], m.data[14]));
+  }
+
+  TRANSFORM_CONSTEXPR static Rigid compose(const Rigid& a, const Rigid& b) {
+    return Rigid(a.r * b.r, a.r * b.t + a.t);
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<T> apply_point(const Vec3<T>& p) const {
+    return r * p + t;
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<T> apply_vector(const Vec3<T>& v) const {
+    return r * v;
+  }
+
+  TRANSFORM_CONSTEXPR Vec4<T> apply(const Vec4<T>& v) const {
+    return Vec4<T>(r * v.xyz() + t * v.w, v.w);
+  }
+
+  TRANSFORM_CONSTEXPR const Rigid& eval() const {
+    return *this;
+  }
+
+  TRANSFORM_CONSTEXPR Rigid inverse() const {
+    Mat3<T> rt = r.transpose();
+    return Rigid(rt, -(rt * t));
+  }
+
+  inline Matrix matrix() const {
+    Matrix m;
+    m.set_column(0, r.c0.point());
+    m.set_column(1, r.c1.point());
+    m.set_column(2, r.c2.point());
+    m.set_column(3, t.point());
+    return m;
+  }
+};
+
+// any linear map followed by a translation
+template<typename T>
+class Affine : public TransformExpr<Affine<T> > {
+public:
+  typedef T scalar;
+  enum { kind = TRANSFORM_AFFINE };
+  typedef Affine inverse_type;
+
+  Mat3<T> m;
+  Vec3<T> t;
+
+  TRANSFORM_CONSTEXPR Affine() {
+  }
+
+  TRANSFORM_CONSTEXPR Affine(const Mat3<T>& m, const Vec3<T>& t)
+    : m(m), t(t) {
+  }
+
+  TRANSFORM_CONSTEXPR Affine(const Rigid<T>& o)
+    : m(o.r), t(o.t) {
+  }
+
+  TRANSFORM_CONSTEXPR static Affine scale(const Vec3<T>& s) {
+    return Affine(Mat3<T>(Vec3<T>(s.x, 0, 0), Vec3<T>(0, s.y, 0), Vec3<T>(0, 0, s.z)),
+                  Vec3<T>());
+  }
+
+  TRANSFORM_CONSTEXPR static Affine compose(const Affine& a, const Affine& b) {
+    return Affine(a.m * b.m, a.m * b.t + a.t);
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<T> apply_point(const Vec3<T>& p) const {
+    return m * p + t;
+  }
+
+  TRANSFORM_CONSTEXPR Vec3<T> apply_vector(const Vec3<T>& v) const {
+    return m * v;
+  }
+
+  TRANSFORM_CONSTEXPR Vec4<T> apply(const Vec4<T>& v) const {
+    return Vec4<T>(m * v.xyz() + t * v.w, v.w);
+  }
+
+  TRANSFORM_CONSTEXPR const Affine& eval() const {
+    return *this;
+  }
+
+  TRANSFORM_CONSTEXPR Affine inverse() const {
+    Mat3<T> mi = m.inverse();
+    return Affine(mi, -(mi * t));
+  }
+
+  inline Matrix matrix() const {
+    return Rigid<T>(m, t).matrix();
+  }
+};
+
+// a full 4x4, column major like Matrix. only this kind has a w row, so
+// it has no apply_point.
+template<typename T>
+class Projective : public TransformExpr<Projective<T> > {
+public:
+  typedef T scalar;
+  enum { kind = TRANSFORM_PROJECTIVE };
+  typedef Projective inverse_type;
+
+  Vec4<T> c0, c1, c2, c3;
+
+  TRANSFORM_CONSTEXPR Projective()
+    : c0(1, 0, 0, 0), c1(0, 1, 0, 0), c2(0, 0, 1, 0), c3(0, 0, 0, 1) {
+  }
+
+  TRANSFORM_CONSTEXPR Projective(const Vec4<T>& c0, const Vec4<T>& c1,
+                                 const Vec4<T>& c2, const Vec4<T>& c3)
+    : c0(c0), c1(c1), c2(c2), c3(c3) {
+  }
+
+  TRANSFORM_CONSTEXPR Projective(const Affine<T>& o)
+    : c0(o.m.c0, 0), c1(o.m.c1, 0), c2(o.m.c2, 0), c3(o.t, 1) {
+  }
+
+  TRANSFORM_CONSTEXPR Projective(const Rigid<T>& o)
+    : c0(o.r.c0, 0), c1(o.r.c1, 0), c2(o.r.c2, 0), c3(o.t, 1) {
+  }
+
+  inline Projective(const Matrix& m)
+    : c0(m.data[0], m.data[1], m.data[2], m.data[3]),
+      c1(m.data[4], m.data[5], m.data[6], m.data[7]),
+      c2(m.data[8], m.data[9], m.data[10], m.data[11]),
+      c3(m.data[12], m.data[13], m.data[14], m.data[15]) {
+  }
+
+  TRANSFORM_CONSTEXPR static Projective compose(const Projective& a, const Projective& b) {
+    return Projective(a.apply(b.c0), a.apply(b.c1), a.apply(b.c2), a.apply(b.c3));
+  }
+
+  TRANSFORM_CONSTEXPR Vec4<T> apply(const Vec4<T>& v) const {
+    return Vec4<T>(v.x * c0.x + v.y * c1.x + v.z * c2.x + v.w * c3.x,
+                   v.x * c0.y + v.y * c1.y + v.z * c2.y + v.w * c3.y,
+                   v.x * c0.z + v.y * c1.z + v.z * c2.z + v.w * c3.z,
+                   v.x * c0.w + v.y * c1.w + v.z * c2.w + v.w * c3.w);
+  }
+
+  TRANSFORM_CONSTEXPR const Projective& eval() const {
+    return *this;
+  }
+
+  // nothing to exploit in general, so this goes through the kernels
+  inline Projective inverse() const {
+    return Projective(matrix().invert());
+  }
+
+  inline Matrix matrix() const {
+    Matrix m;
+    const Vec4<T>* cols[4] = {&c0, &c1, &c2, &c3};
+    for(unsigned c = 0; c < 4; ++c) {
+      m.elm(0,c) = cols[c]->x;
+      m.elm(1,c) = cols[c]->y;
+      m.elm(2,c) = cols[c]->z;
+      m.elm(3,c) = cols[c]->w;
+    }
+    return m;
+  }
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "uniform_blocks.h"
+#include "gl_state.h"
+#include "utils.h"
+
+#include <string.h>
+
+UniformBlocks::UniformBlocks(unsigned ring_size)
+  : buffers(uniform_blocks_supported()), ring(0), ring_size(ring_size), head(0),
+    alignment(1), have_frame(false) {
+#ifdef GL_UNIFORM_BUFFER
+  if(!buffers) return;
+
+  GLint align = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+  if(align > 0) alignment = align;
+
+  gl_check(glGenBuffers(1, &ring));
+  gl_state.bind_buffer(GL_UNIFORM_BUFFER, ring);
+  gl_check(glBufferData(GL_UNIFORM_BUFFER, ring_size, NULL, GL_STREAM_DRAW));
+#endif
+}
+
+UniformBlocks::~UniformBlocks() {
+  if(!ring) return;
+  gl_state.deleted_buffer(ring);
+  glDeleteBuffers(1, &ring);
+}
+
+// where data landed in the ring
+unsigned UniformBlocks::upload(const void* data, unsigned size) {
+#ifdef GL_UNIFORM_BUFFER
+  unsigned offset = (head + alignment - 1) / alignment * alignment;
+  if(offset + size > ring_size) {
+    // draws still reading the old storage keep it, we get a new one.
+    // the frame's block went with it so that comes first again.
+    gl_state.bind_buffer(GL_UNIFORM_BUFFER, ring);
+    gl_check(glBufferData(GL_UNIFORM_BUFFER, ring_size, NULL, GL_STREAM_DRAW));
+    head = 0;
+    if(have_frame) bind_frame();
+    offset = (head + alignment - 1) / alignment * alignment;
+  }
+
+  gl_state.bind_buffer(GL_UNIFORM_BUFFER, ring);
+  gl_check(glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data));
+  head = offset + size;
+  return offset;
+#else
+  return 0;
+#endif
+}
+
+void UniformBlocks::bind_frame() {
+#ifdef GL_UNIFORM_BUFFER
+  unsigned offset = upload(&frame, sizeof(frame));
+  gl_state.bind_uniform_range(BLOCK_FRAME, ring, offset, sizeof(frame));
+#endif
+}
+
+void UniformBlocks::set_frame(const FrameBlock& new_frame) {
+  frame = new_frame;
+  have_frame = false;
+  if(buffers) bind_frame();
+  have_frame = true;
+}
+
+void UniformBlocks::set_object(Program* program, const ObjectBlock& object) {
+  if(buffers) {
+#ifdef GL_UNIFORM_BUFFER
+    unsigned offset = upload(&object, sizeof(object));
+    gl_state.bind_uniform_range(BLOCK_OBJECT, ring, offset, sizeof(object));
+#endif
+    return;
+  }
+
+  // each program only has the members its shaders use
+  Matrix m;
+  if(program->has_uniform(UNIFORM_V)) {
+    memcpy(m.data, frame.view, sizeof(m.data));
+    program->bind_uniform(m, UNIFORM_V);
+  }
+  if(program->has_uniform(UNIFORM_PERSPECTIVE)) {
+    memcpy(m.data, frame.perspective, sizeof(m.data));
+    program->bind_uniform(m, UNIFORM_PERSPECTIVE);
+  }
+  if(program->has_uniform(UNIFORM_PERSPECTIVE_INV)) {
+    memcpy(m.data, frame.perspective_inv, sizeof(m.data));
+    program->bind_uniform(m, UNIFORM_PERSPECTIVE_INV);
+  }
+  if(program->has_uniform(UNIFORM_LIGHT0_POSITION)) {
+    program->bind_uniform(Vector(frame.light[0], frame.light[1], frame.light[2]),
+                          UNIFORM_LIGHT0_POSITION);
+  }
+  if(program->has_uniform(UNIFORM_TIME)) program->bind_uniform(frame.time, UNIFORM_TIME);
+  if(program->has_uniform(UNIFORM_MV)) {
+    memcpy(m.data, object.mv, sizeof(m.data));
+    program->bind_uniform(m, UNIFORM_MV);
+  }
+}
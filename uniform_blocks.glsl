@@ -0,0 +1,24 @@
+// data shared by every draw in a frame and data for one draw. with
+// uniform buffers these are std140 blocks laid out like FrameBlock and
+// ObjectBlock in uniform_blocks.h, without they're plain uniforms.
+#ifdef UNIFORM_BLOCKS
+layout(std140) uniform Frame {
+  mat4 view;
+  mat4 perspective;
+  mat4 perspective_inv;
+  vec3 light; // camera space
+  float time;
+};
+
+layout(std140) uniform Object {
+  mat4 mv;
+};
+#else
+uniform mat4 view;
+uniform mat4 perspective;
+uniform mat4 perspective_inv;
+uniform vec3 light;
+uniform float time;
+
+uniform mat4 mv;
+#endif
@@ -0,0 +1,54 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include "gl_headers.h"
+#include "shaders.h"
+
+// std140 images of the blocks in uniform_blocks.glsl. every member
+// here happens to fall on its std140 offset with no padding.
+struct FrameBlock {
+  float view[16];
+  float perspective[16];
+  float perspective_inv[16];
+  float light[3];
+  float time;
+};
+
+struct ObjectBlock {
+  float mv[16];
+};
+
+// feeds the Frame and Object blocks. with uniform buffers both are
+// sub-allocated from one ring buffer: the frame's data is uploaded and
+// bound once, each object costs an upload and a glBindBufferRange
+// however many members it has. when the ring fills up its storage is
+// orphaned and allocation starts over.
+//
+// without uniform buffers the members are set as plain uniforms on
+// each program instead, where Program skips the ones that haven't
+// changed.
+class UniformBlocks {
+ public:
+  UniformBlocks(unsigned ring_size = 64 * 1024);
+  ~UniformBlocks();
+
+  void set_frame(const FrameBlock& frame);
+
+  // for the next draw with program, which must be in use
+  void set_object(Program* program, const ObjectBlock& object);
+
+ private:
+  bool buffers;
+  GLuint ring;
+  unsigned ring_size;
+  unsigned head;
+  unsigned alignment;
+
+  FrameBlock frame;
+  bool have_frame;
+
+  unsigned upload(const void* data, unsigned size);
+  void bind_frame();
+};
+
+#endif
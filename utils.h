@@ -33,25 +33,8 @@ long timer_elapsed_msecs(Timer timer);
 long timer_elapsed_usecs(Timer timer);
 long abs_utime();
 
-#define DISABLE_PROFILING
-
-#ifndef DISABLE_PROFILING
-#define PROFILE_START(timer, message) do {                              \
-    if(!(timer)->pf) {                                                  \
-      (timer)->pf = fopen(message, "w");                                \
-    }                                                                   \
-    timer_start(timer);                                                 \
-  } while(0)
-
-#define PROFILE_END(timer) do {                                  \
-    long usecs = timer_elapsed_usecs(timer);                     \
-    fprintf((timer)->pf, "%ld %ld\n", abs_utime(), usecs);       \
-  } while(0)
-#else
-#define PROFILE_START(timer, message)
-#define PROFILE_END(timer)
-#endif
-
+// the path filename is found at, in a static buffer
+const char* filename_resolve(const char* filename);
 long filename_size(const char* filename);
 char* filename_slurp(const char* filename);
 
@@ -0,0 +1,75 @@
+#include "workers.h"
+#include "utils.h"
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+
+#include <vector>
+
+// stop and reap the workers already started, so a failed fork doesn't
+// leave them rendering with nobody waiting on them
+static void kill_workers(const std::vector<pid_t>& pids) {
+  for(size_t ii = 0; ii < pids.size(); ++ii) kill(pids[ii], SIGTERM);
+  for(size_t ii = 0; ii < pids.size(); ++ii) {
+    pid_t pid;
+    do {
+      pid = waitpid(pids[ii], NULL, 0);
+    } while(pid < 0 && errno == EINTR);
+  }
+}
+
+bool fork_workers(unsigned nworkers, unsigned* start, unsigned* end, int* exit_status) {
+  unsigned first = *start;
+  unsigned count = *end - *start;
+  *exit_status = 0;
+
+  if(nworkers > count) nworkers = count;
+  if(nworkers == 0) return false;
+
+  // flush before forking so buffered output isn't duplicated
+  fflush(stdout);
+  fflush(stderr);
+
+  std::vector<pid_t> pids;
+  for(unsigned ii = 0; ii < nworkers; ++ii) {
+    // spread the remainder over the first workers. the products are
+    // 64 bit so large ranges split many ways don't wrap.
+    unsigned wstart = first + (unsigned)((unsigned long long)count * ii / nworkers);
+    unsigned wend = first + (unsigned)((unsigned long long)count * (ii + 1) / nworkers);
+
+    pid_t pid = fork();
+    if(pid < 0) {
+      int error = errno;
+      kill_workers(pids);
+      fail_exit("fork failed: %s", strerror(error));
+    } else if(pid == 0) {
+      *start = wstart;
+      *end = wend;
+      return true;
+    }
+
+    pids.push_back(pid);
+    LOGI("worker %d: frames %u to %u", (int)pid, wstart, wend - 1);
+  }
+
+  for(unsigned ii = 0; ii < nworkers; ++ii) {
+    int status;
+    pid_t pid;
+    do {
+      pid = wait(&status);
+    } while(pid < 0 && errno == EINTR);
+
+    if(pid < 0) fail_exit("wait failed: %s", strerror(errno));
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      LOGW("worker %d failed", (int)pid);
+      *exit_status = 1;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,13 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+// split the frame range [start, end) into nworkers contiguous pieces and
+// fork a process for each. this must happen before any GL context exists
+// so that every worker can create its own.
+//
+// returns true in a worker with start/end narrowed to its piece. the
+// parent waits for every worker and returns false; exit_status is then
+// nonzero if any worker failed.
+bool fork_workers(unsigned nworkers, unsigned* start, unsigned* end, int* exit_status);
+
+#endif